@@ -21,12 +21,17 @@ public:
         return distribution(rng);
     }
 
-    // Generate a random integer within a range
+    // Generate a random float within a range
     float getRandomFloat(float min, float max) {
         std::uniform_real_distribution<float> distribution(min, max);
         return distribution(rng);
     }
 
+    // Restart the sequence from a fixed seed, making scene setup reproducible
+    void seed(unsigned int value) {
+        rng.seed(value);
+    }
+
 private:
     // Private constructor for Singleton
     RandomNumberGenerator() : rng(std::random_device{}()) {}
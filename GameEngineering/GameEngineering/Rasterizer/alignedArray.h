@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstring>
+#include <new>
+
+// Array whose storage is aligned for SIMD loads and stores.
+// The allocation is rounded up to a whole number of 8-wide vectors, so kernels can
+// always process full vectors without a scalar tail loop.
+template <typename T, size_t Alignment = 32>
+class AlignedArray {
+    T* data = nullptr;   // Aligned storage
+    size_t count = 0;    // Number of elements requested
+    size_t padded = 0;   // Number of elements allocated
+
+    void allocate(size_t n) {
+        count = n;
+        padded = (n + 7) & ~size_t(7);
+        data = padded ? static_cast<T*>(::operator new[](padded * sizeof(T), std::align_val_t(Alignment))) : nullptr;
+        if (data) memset(data, 0, padded * sizeof(T));
+    }
+
+    void release() {
+        if (data) ::operator delete[](data, std::align_val_t(Alignment));
+        data = nullptr;
+        count = padded = 0;
+    }
+
+public:
+    AlignedArray() {}
+
+    // Constructor allocating n zeroed elements
+    // Input Variables:
+    // - n: Number of elements
+    explicit AlignedArray(size_t n) { allocate(n); }
+
+    AlignedArray(const AlignedArray& other) {
+        allocate(other.count);
+        if (data) memcpy(data, other.data, padded * sizeof(T));
+    }
+
+    AlignedArray& operator=(const AlignedArray& other) {
+        if (this != &other) {
+            resize(other.count);
+            if (other.data) memcpy(data, other.data, other.padded * sizeof(T));
+        }
+        return *this;
+    }
+
+    ~AlignedArray() { release(); }
+
+    // Changes the number of elements. The allocation is kept (with its contents) when it is
+    // already big enough, so buffers reused every frame stop allocating once warmed up.
+    // Input Variables:
+    // - n: New number of elements
+    void resize(size_t n) {
+        if (n <= padded) {
+            count = n;
+            return;
+        }
+        release();
+        allocate(n);
+    }
+
+    size_t size() const { return count; }
+
+    // Number of elements including the padding, always a multiple of 8
+    size_t paddedSize() const { return padded; }
+
+    T* get() { return data; }
+    const T* get() const { return data; }
+
+    T& operator[](size_t i) { return data[i]; }
+    const T& operator[](size_t i) const { return data[i]; }
+};
@@ -0,0 +1,275 @@
+#include <iostream>
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "platform.h" // Window framework on Windows, portable stand-ins elsewhere
+#include "renderer.h"
+#include "RNG.h"
+#include "simd.h"
+#include "threadPool.h"
+#include "profiler.h"
+#include "stats.h"
+#include "pipeline.h"
+#include "scenes.h"
+#include "rasterCheck.h"
+#include "matrixCheck.h"
+
+// Deterministic benchmark of the rasterizer.
+// Every scene is built from a fixed seed and rendered offscreen for a fixed number of frames,
+// so runs differ only in timing. Results are written as JSON for regression tracking.
+//
+// Usage: benchmark [--frames N] [--warmup N] [--seed N] [--cubes N] [--spheres N]
+//                  [--tessellation N] [--layers N] [--objects N] [--simd scalar|sse41|avx2]
+//                  [--out file.json] [--trace trace.json] [--overdraw] [--visibility] [--prepass]
+//                  [--no-sort] [--no-occlusion] [--rgb24] [--full-clear]
+//        benchmark --check
+// --simd picks the kernels, capped at the best the CPU supports; the JSON records the level used.
+// --check runs the raster coverage checks of rasterCheck.h and the matrix checks of matrixCheck.h
+// instead, and exits with 1 if any fails.
+
+// Settings of a benchmark run
+struct BenchmarkOptions {
+    unsigned int frames = 300;       // Timed frames per scene
+    unsigned int warmup = 30;        // Untimed frames rendered first, to warm caches and the thread pool
+    unsigned int seed = 12345;       // Seed of the random number generator, set before every scene
+    unsigned int cubes = 4096;       // Number of cubes in the cube stress scene, rounded down to a cube number
+    unsigned int spheres = 5;        // Number of spheres in the sphere stress scene
+    int tessellation = 100;          // Latitude divisions of each stress sphere
+    unsigned int layers = 16;        // Number of full-screen layers in the overdraw scene
+    unsigned int objects = 4096;     // Number of cubes hidden behind the facades of the city scene
+    std::string out;                 // JSON output file, standard output if empty
+    std::string trace;               // Chrome trace of the run, not recorded if empty
+    bool overdraw = false;           // Also count overwritten pixels, at the cost of a Z-buffer pass per frame
+    bool visibility = false;         // Shade through the visibility buffer instead of while rasterizing
+    bool prepass = false;            // Rasterize depth before shading
+    bool sort = true;                // Draw front to back instead of in submission order
+    bool occlusion = true;           // Cull items hidden behind occluders
+    bool packed = true;              // Draw into the BGRA32 back buffer rather than the RGB24 image
+    bool lazyClear = true;           // Clear Z-buffer tiles on first use
+    bool check = false;              // Run the raster coverage and matrix checks instead of the benchmark
+    SimdLevel simd = detectSimdLevel(); // Kernels requested, lowered to what the CPU supports before the run
+};
+
+// Timings and work of one scene
+struct SceneResult {
+    std::string name;
+    std::vector<double> frameMs;     // Time of every timed frame in milliseconds
+    RenderStats stats;               // Counters summed over all timed frames
+};
+
+// Renders a scene for the warmup and timed frames
+// Input Variables:
+// - renderer: Headless renderer to draw with
+// - scene: Scene to animate and draw
+// - options: Frame counts
+// Returns the timings and work of the timed frames
+SceneResult runBenchmark(Renderer& renderer, Scene& scene, const BenchmarkOptions& options) {
+    SceneResult result;
+    result.name = scene.name();
+    result.frameMs.reserve(options.frames);
+
+    for (unsigned int frame = 0; frame < options.warmup + options.frames; frame++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        PROFILE_SCOPE("frame");
+        renderer.clear();
+        {
+            PROFILE_SCOPE("update");
+            scene.update();
+        }
+        renderSceneMT(renderer, scene.meshes, scene.instanced, scene.camera, scene.L);
+        renderer.present();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        if (frame < options.warmup) continue;
+        result.frameMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        result.stats += frameStats;
+    }
+    return result;
+}
+
+// Returns the value below which the given fraction of the sorted samples lie (nearest rank)
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+    return sorted[min(max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+// Writes the results of all scenes as one JSON document
+// Input Variables:
+// - os: Stream to write to
+// - options: Settings of the run
+// - renderer: Renderer used, for the resolution
+// - results: One entry per scene
+void writeJSON(std::ostream& os, const BenchmarkOptions& options, Renderer& renderer, const std::vector<SceneResult>& results) {
+    os << std::fixed << std::setprecision(3);
+    os << "{\n";
+    os << "  \"seed\": " << options.seed << ",\n";
+    os << "  \"frames\": " << options.frames << ",\n";
+    os << "  \"warmup\": " << options.warmup << ",\n";
+    os << "  \"width\": " << renderer.canvas.getWidth() << ",\n";
+    os << "  \"height\": " << renderer.canvas.getHeight() << ",\n";
+    os << "  \"threads\": " << ThreadPool::getInstance().threadCount() << ",\n";
+    os << "  \"simd\": \"" << simdName(simdLevel()) << "\",\n";
+    os << "  \"simd_requested\": \"" << simdName(options.simd) << "\",\n";
+    os << "  \"shading\": \"" << (renderer.visibilityBuffer ? "visibility" : "forward") << "\",\n";
+    os << "  \"front_to_back\": " << (renderer.frontToBack ? "true" : "false") << ",\n";
+    os << "  \"depth_prepass\": " << (renderer.depthPrepass ? "true" : "false") << ",\n";
+    os << "  \"occlusion_culling\": " << (renderer.occlusionCulling ? "true" : "false") << ",\n";
+    os << "  \"lazy_depth_clear\": " << (renderer.lazyDepthClear ? "true" : "false") << ",\n";
+    os << "  \"pixel_format\": \"" << (renderer.canvas.getPixelFormat() == PixelFormat::BGRA32 ? "bgra32" : "rgb24") << "\",\n";
+    os << "  \"scenes\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const SceneResult& r = results[i];
+        std::vector<double> sorted = r.frameMs;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (double ms : sorted) total += ms;
+        double mean = sorted.empty() ? 0.0 : total / sorted.size();
+        double seconds = total / 1000.0;
+        size_t frames = max(sorted.size(), (size_t)1);
+
+        os << "    {\n";
+        os << "      \"name\": \"" << r.name << "\",\n";
+        os << "      \"frame_ms\": { \"mean\": " << mean << ", \"p50\": " << percentile(sorted, 0.5)
+           << ", \"p99\": " << percentile(sorted, 0.99) << ", \"max\": " << (sorted.empty() ? 0.0 : sorted.back()) << " },\n";
+        os << "      \"triangles_per_frame\": " << r.stats.triangles / frames << ",\n";
+        os << "      \"pixels_per_frame\": " << r.stats.pixels / frames << ",\n";
+        os << "      \"triangles_per_second\": " << (seconds > 0.0 ? r.stats.triangles / seconds : 0.0) << ",\n";
+        os << "      \"pixels_per_second\": " << (seconds > 0.0 ? r.stats.pixels / seconds : 0.0) << ",\n";
+        // Average number of times each screen pixel was shaded, 1 when nothing hidden is shaded
+        double screenPixels = (double)renderer.canvas.getWidth() * renderer.canvas.getHeight();
+        os << "      \"shaded_per_screen_pixel\": " << (double)r.stats.pixels / frames / screenPixels << ",\n";
+
+        // Per-frame averages of the pipeline counters
+        const RenderStats& s = r.stats;
+        os << "      \"stats_per_frame\": {\n";
+        os << "        \"draw_items\": " << s.drawItems / frames << ", \"visible_items\": " << s.visibleItems / frames
+           << ", \"items_occluded\": " << s.itemsOccluded / frames << ",\n";
+        os << "        \"triangles_submitted\": " << s.trianglesSubmitted / frames
+           << ", \"triangles_frustum_culled\": " << s.trianglesFrustumCulled / frames
+           << ", \"triangles_occluded\": " << s.trianglesOccluded / frames
+           << ", \"triangles_clipped\": " << s.trianglesClipped / frames << ",\n";
+        os << "        \"triangles_back_facing\": " << s.trianglesBackFacing / frames
+           << ", \"triangles_too_small\": " << s.trianglesTooSmall / frames << ",\n";
+        os << "        \"pixels_tested\": " << s.pixelsTested / frames << ", \"pixels_shaded\": " << s.pixels / frames
+           << ", \"pixels_overwritten\": " << s.pixelsOverwritten / frames
+           << ", \"pixels_resolved\": " << s.pixelsResolved / frames << "\n";
+        os << "      }\n";
+        os << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n";
+    os << "}\n";
+}
+
+// Entry point of the benchmark
+// Input Variables:
+// - argv: Options, see the usage above
+int main(int argc, char** argv) {
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--frames") == 0 && hasValue) options.frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && hasValue) options.warmup = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue) options.seed = static_cast<unsigned int>(strtoul(argv[++i], nullptr, 10));
+        else if (strcmp(argv[i], "--cubes") == 0 && hasValue) options.cubes = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--spheres") == 0 && hasValue) options.spheres = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tessellation") == 0 && hasValue) options.tessellation = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--layers") == 0 && hasValue) options.layers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--objects") == 0 && hasValue) options.objects = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--out") == 0 && hasValue) options.out = argv[++i];
+        else if (strcmp(argv[i], "--trace") == 0 && hasValue) options.trace = argv[++i];
+        else if (strcmp(argv[i], "--overdraw") == 0) options.overdraw = true;
+        else if (strcmp(argv[i], "--visibility") == 0) options.visibility = true;
+        else if (strcmp(argv[i], "--prepass") == 0) options.prepass = true;
+        else if (strcmp(argv[i], "--no-sort") == 0) options.sort = false;
+        else if (strcmp(argv[i], "--no-occlusion") == 0) options.occlusion = false;
+        else if (strcmp(argv[i], "--rgb24") == 0) options.packed = false;
+        else if (strcmp(argv[i], "--full-clear") == 0) options.lazyClear = false;
+        else if (strcmp(argv[i], "--check") == 0) options.check = true;
+        else if (strcmp(argv[i], "--simd") == 0 && hasValue) {
+            std::string level = argv[++i];
+            auto name = std::find(std::begin(simdNames), std::end(simdNames), level);
+            if (name == std::end(simdNames)) {
+                std::cerr << "Unknown SIMD level " << level << ", expected --simd scalar|sse41|avx2\n";
+                return 1;
+            }
+            options.simd = static_cast<SimdLevel>(name - std::begin(simdNames));
+        }
+        else {
+            std::cerr << "Unknown option " << argv[i] << "\n";
+            return 1;
+        }
+    }
+
+    // Kernels the CPU cannot run are never selected, a higher request falls back to the best supported
+    simdLevel() = min(options.simd, detectSimdLevel());
+    if (simdLevel() != options.simd)
+        std::cerr << "--simd " << simdName(options.simd) << " is not supported here, using " << simdName(simdLevel()) << "\n";
+
+    // Profiling adds a little work to every scope, so only turn it on when a trace is wanted
+    Profiler& profiler = Profiler::getInstance();
+    profiler.setThreadName("main");
+    profiler.setEnabled(!options.trace.empty());
+
+    Renderer renderer(true);
+    renderer.measureOverdraw = options.overdraw;
+    renderer.visibilityBuffer = options.visibility;
+    renderer.depthPrepass = options.prepass;
+    renderer.frontToBack = options.sort;
+    renderer.occlusionCulling = options.occlusion;
+    renderer.canvas.setPixelFormat(options.packed ? PixelFormat::BGRA32 : PixelFormat::RGB24);
+    renderer.lazyDepthClear = options.lazyClear;
+
+    // The coverage checks draw with every SIMD level themselves, whatever --simd asked for
+    if (options.check) {
+        unsigned int failures = checkRasterCoverage(renderer, std::cout) + checkMatrixHelpers(std::cout);
+        std::cout << (failures ? std::to_string(failures) + " checks failed" : std::string("All checks passed")) << "\n";
+        return failures ? 1 : 0;
+    }
+    RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
+
+    // Scenes are created one at a time, right after seeding, so each is the same whatever runs before it
+    std::vector<SceneResult> results;
+    auto run = [&](auto makeScene) {
+        rng.seed(options.seed);
+        std::unique_ptr<Scene> scene = makeScene();
+        std::cerr << scene->name() << "...\n";
+        results.push_back(runBenchmark(renderer, *scene, options));
+    };
+
+    unsigned int dim = 1;
+    while ((dim + 1) * (dim + 1) * (dim + 1) <= options.cubes) dim++;
+
+    run([] { return std::make_unique<Scene1>(); });
+    run([] { return std::make_unique<Scene2>(); });
+    run([] { return std::make_unique<Scene3>(); });
+    run([&] { return std::make_unique<CubeBlock>(dim, 2.5f); });
+    run([&] { return std::make_unique<SphereScene>(options.spheres, options.tessellation); });
+    run([&] { return std::make_unique<OverdrawScene>(options.layers); });
+    run([&] { return std::make_unique<CityScene>(24, options.objects); });
+
+    if (!options.trace.empty() && !profiler.writeChromeTrace(options.trace))
+        std::cerr << "Cannot write " << options.trace << "\n";
+
+    if (options.out.empty()) {
+        writeJSON(std::cout, options, renderer, results);
+    }
+    else {
+        std::ofstream file(options.out);
+        if (!file) {
+            std::cerr << "Cannot write " << options.out << "\n";
+            return 1;
+        }
+        writeJSON(file, options, renderer, results);
+    }
+    return 0;
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "vec4.h"
+#include "matrix.h"
+#include "mesh.h"
+#include "frustum.h"
+#include "instancing.h"
+
+// Bounding volume hierarchy over the world-space bounding spheres of a scene's draw items.
+// Nodes hold axis-aligned boxes around the spheres below them, and every node covers a
+// contiguous range of items, so a node found fully inside the frustum is emitted in one go.
+// The tree is rebuilt when the list of draw items changes and refitted bottom-up, touching only
+// the ancestors of items that moved, when just their world matrices change.
+class SceneBVH {
+    static const int leafSize = 4; // Maximum number of draw items in a leaf
+
+    struct Node {
+        vec4 minV, maxV;         // Bounds of every sphere below the node
+        int left = -1, right = -1; // Child nodes, -1 for leaves
+        int parent = -1;
+        unsigned int first = 0;  // Items covered by the node are [first, first + count)
+        unsigned int count = 0;
+        bool dirty = false;      // Bounds need refitting
+    };
+
+    struct Item {
+        const Mesh* geometry;
+        const matrix* worldPtr;  // Current world matrix of the draw item
+        unsigned int index;      // Position of the item in the draw list
+        matrix world;            // World matrix the sphere was computed from
+        vec4 center;             // World-space bounding sphere
+        float radius;
+        int leaf;                // Leaf node holding the item
+    };
+
+    std::vector<Node> nodes;     // Nodes in depth-first order, parents before children
+    std::vector<Item> items;     // Items in leaf order
+    std::vector<DrawItem> built; // Draw list the tree was built for
+
+    // Builds the subtree for items [first, first + count) by splitting at the median
+    // along the axis where the sphere centers are most spread out
+    int build(unsigned int first, unsigned int count, int parent) {
+        int index = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+        nodes[index].parent = parent;
+        nodes[index].first = first;
+        nodes[index].count = count;
+
+        if (count <= leafSize) {
+            for (unsigned int i = first; i < first + count; i++)
+                items[i].leaf = index;
+        }
+        else {
+            vec4 cmin = items[first].center, cmax = items[first].center;
+            for (unsigned int i = first + 1; i < first + count; i++)
+                for (unsigned int a = 0; a < 3; a++) {
+                    cmin[a] = min(cmin[a], items[i].center[a]);
+                    cmax[a] = max(cmax[a], items[i].center[a]);
+                }
+            unsigned int axis = 0;
+            for (unsigned int a = 1; a < 3; a++)
+                if (cmax[a] - cmin[a] > cmax[axis] - cmin[axis]) axis = a;
+
+            unsigned int half = count / 2;
+            std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+                [axis](const Item& a, const Item& b) { return a.center[axis] < b.center[axis]; });
+
+            int left = build(first, half, index);
+            int right = build(first + half, count - half, index);
+            nodes[index].left = left;
+            nodes[index].right = right;
+        }
+
+        fit(nodes[index]);
+        return index;
+    }
+
+    // Recomputes a node's bounds from its items (leaves) or children
+    void fit(Node& node) {
+        if (node.left < 0) {
+            const Item& item = items[node.first];
+            node.minV = vec4(item.center[0] - item.radius, item.center[1] - item.radius, item.center[2] - item.radius);
+            node.maxV = vec4(item.center[0] + item.radius, item.center[1] + item.radius, item.center[2] + item.radius);
+            for (unsigned int i = node.first + 1; i < node.first + node.count; i++)
+                for (unsigned int a = 0; a < 3; a++) {
+                    node.minV[a] = min(node.minV[a], items[i].center[a] - items[i].radius);
+                    node.maxV[a] = max(node.maxV[a], items[i].center[a] + items[i].radius);
+                }
+        }
+        else {
+            const Node& l = nodes[node.left];
+            const Node& r = nodes[node.right];
+            for (unsigned int a = 0; a < 3; a++) {
+                node.minV[a] = min(l.minV[a], r.minV[a]);
+                node.maxV[a] = max(l.maxV[a], r.maxV[a]);
+            }
+        }
+        node.dirty = false;
+    }
+
+    void rebuild(const std::vector<DrawItem>& draws) {
+        built = draws;
+        items.resize(draws.size());
+        for (unsigned int i = 0; i < draws.size(); i++) {
+            Item& item = items[i];
+            item.geometry = draws[i].geometry;
+            item.worldPtr = draws[i].world;
+            item.index = i;
+            item.world = *draws[i].world;
+            item.geometry->getWorldBounds(item.world, item.center, item.radius);
+        }
+
+        nodes.clear();
+        if (!items.empty())
+            build(0, static_cast<unsigned int>(items.size()), -1);
+    }
+
+    void refit() {
+        bool changed = false;
+        for (Item& item : items) {
+            if (*item.worldPtr == item.world) continue;
+            item.world = *item.worldPtr;
+
+            vec4 center;
+            float radius;
+            item.geometry->getWorldBounds(item.world, center, radius);
+            if (center[0] == item.center[0] && center[1] == item.center[1] && center[2] == item.center[2] && radius == item.radius)
+                continue; // e.g. a mesh spinning around its own center
+            item.center = center;
+            item.radius = radius;
+
+            // Mark the path to the root, stopping where an earlier item already did
+            for (int n = item.leaf; n >= 0 && !nodes[n].dirty; n = nodes[n].parent)
+                nodes[n].dirty = true;
+            changed = true;
+        }
+        if (!changed) return;
+
+        // Children come after their parents, so a reverse sweep refits bottom-up
+        for (size_t n = nodes.size(); n-- > 0;)
+            if (nodes[n].dirty) fit(nodes[n]);
+    }
+
+public:
+    // Brings the tree up to date with the scene: a full rebuild if draw items were added, removed
+    // or reordered, otherwise a refit of the nodes above items whose world matrix changed.
+    // Changes to a mesh's vertices need Mesh::updateBounds and a changed list to be picked up.
+    // Input Variables:
+    // - draws: Draw items to organise
+    void update(const std::vector<DrawItem>& draws) {
+        if (draws != built)
+            rebuild(draws);
+        else
+            refit();
+    }
+
+    // Collects the draw items whose bounding spheres may be visible.
+    // Subtrees outside the frustum are skipped and subtrees fully inside are taken without
+    // further tests. The result keeps the order of the draw list, so drawing order is unchanged.
+    // Input Variables:
+    // - frustum: View frustum in world space
+    // Output Variables:
+    // - visible: Receives the indices of the draw items that pass, in ascending order
+    void cull(const Frustum& frustum, std::vector<unsigned int>& visible) {
+        visible.clear();
+        if (nodes.empty()) return;
+
+
+        // Each stack entry carries the planes its parent was not yet fully inside of
+        struct Entry { int node; unsigned int planes; };
+        Entry stack[64];
+        int top = 0;
+        stack[top++] = { 0, Frustum::allPlanes };
+        while (top > 0) {
+            Entry entry = stack[--top];
+            const Node& node = nodes[entry.node];
+            Visibility v = frustum.testBox(node.minV, node.maxV, entry.planes);
+            if (v == Visibility::Outside) continue;
+
+            if (v == Visibility::Inside) {
+                for (unsigned int i = node.first; i < node.first + node.count; i++)
+                    visible.push_back(items[i].index);
+            }
+            else if (node.left < 0) {
+                for (unsigned int i = node.first; i < node.first + node.count; i++)
+                    if (frustum.testSphere(items[i].center, items[i].radius, entry.planes) != Visibility::Outside)
+                        visible.push_back(items[i].index);
+            }
+            else {
+                stack[top++] = { node.right, entry.planes };
+                stack[top++] = { node.left, entry.planes };
+            }
+        }
+
+        std::sort(visible.begin(), visible.end());
+    }
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "vec4.h"
+#include "mesh.h"
+
+// Clip-space planes a vertex can lie outside of, combined into an outcode.
+// The projection maps the visible depth range to 0 <= z <= w (see matrix::makePerspective).
+enum ClipPlane : unsigned int {
+    CLIP_NEAR = 1,   // z < 0
+    CLIP_FAR = 2,    // z > w
+    CLIP_LEFT = 4,   // x < -guardBand * w
+    CLIP_RIGHT = 8,  // x > guardBand * w
+    CLIP_BOTTOM = 16, // y < -guardBand * w
+    CLIP_TOP = 32    // y > guardBand * w
+};
+
+// Clips triangles against the view volume in homogeneous clip space, before the perspective divide.
+// x and y are only clipped against a guard band much larger than the screen: triangles that
+// are merely partly off screen are left whole and the rasterizer's screen clamp handles them,
+// so in practice only near and far plane crossings generate new vertices.
+class Clipper {
+public:
+    static constexpr float guardBand = 8.f; // Guard band size, in multiples of the screen half-size
+    static const int maxVertices = 9;       // A triangle gains at most one vertex per clip plane
+
+    // Computes which clip planes a clip-space position lies outside of
+    // Input Variables:
+    // - p: Clip-space position
+    // Returns a combination of ClipPlane bits, 0 if the position is inside
+    static unsigned int outcode(const vec4& p) {
+        float g = guardBand * p[3];
+        unsigned int code = 0;
+        if (p[2] < 0.f) code |= CLIP_NEAR;
+        if (p[2] > p[3]) code |= CLIP_FAR;
+        if (p[0] < -g) code |= CLIP_LEFT;
+        if (p[0] > g) code |= CLIP_RIGHT;
+        if (p[1] < -g) code |= CLIP_BOTTOM;
+        if (p[1] > g) code |= CLIP_TOP;
+        return code;
+    }
+
+    // Clips a triangle with the Sutherland-Hodgman algorithm.
+    // Positions, normals and colours of new vertices are interpolated linearly in clip space.
+    // Input Variables:
+    // - in: Triangle vertices, positions in clip space
+    // - planes: ClipPlane bits to clip against, normally the OR of the vertex outcodes
+    // Output Variables:
+    // - out: Convex polygon with room for maxVertices entries, in the winding order of the input
+    // Returns the number of polygon vertices, fewer than 3 if the triangle was clipped away
+    static int clip(const Vertex in[3], unsigned int planes, Vertex* out) {
+        Vertex buffer[2][maxVertices];
+        const Vertex* src = in;
+        int count = 3;
+        int target = 0;
+
+        for (unsigned int plane = CLIP_NEAR; plane <= CLIP_TOP && count >= 3; plane <<= 1) {
+            if (!(planes & plane)) continue;
+
+            Vertex* dst = buffer[target];
+            int n = 0;
+            for (int i = 0; i < count; i++) {
+                const Vertex& a = src[i];
+                const Vertex& b = src[(i + 1) % count];
+                float da = distance(a.p, plane);
+                float db = distance(b.p, plane);
+
+                if (da >= 0.f) dst[n++] = a;
+                // Always interpolate from the inside vertex, so an edge shared by two triangles
+                // is cut at exactly the same point and no crack opens between them
+                if (da >= 0.f && db < 0.f)
+                    lerp(a, b, da / (da - db), dst[n++]);
+                else if (da < 0.f && db >= 0.f)
+                    lerp(b, a, db / (db - da), dst[n++]);
+            }
+
+            src = dst;
+            count = n;
+            target ^= 1;
+        }
+
+        for (int i = 0; i < count; i++)
+            out[i] = src[i];
+        return count;
+    }
+
+    // Applies the perspective divide and viewport mapping to a clipped vertex,
+    // matching what VertexTransform does for vertices that needed no clipping
+    // Input Variables:
+    // - width, height: Screen dimensions in pixels
+    // Output Variables:
+    // - v: Vertex converted from clip space to screen space
+    static void toScreen(Vertex& v, float width, float height) {
+        v.p.divideW();
+        v.p[0] = (v.p[0] + 1.f) * 0.5f * width;
+        v.p[1] = height - (v.p[1] + 1.f) * 0.5f * height;
+    }
+
+private:
+    // Signed distance to a clip plane, positive on the inside
+    static float distance(const vec4& p, unsigned int plane) {
+        switch (plane) {
+        case CLIP_NEAR: return p[2];
+        case CLIP_FAR: return p[3] - p[2];
+        case CLIP_LEFT: return p[0] + guardBand * p[3];
+        case CLIP_RIGHT: return guardBand * p[3] - p[0];
+        case CLIP_BOTTOM: return p[1] + guardBand * p[3];
+        default: return guardBand * p[3] - p[1];
+        }
+    }
+
+    // Interpolates every attribute of two vertices
+    static void lerp(const Vertex& a, const Vertex& b, float t, Vertex& out) {
+        float s = 1.f - t;
+        out.p = vec4(a.p[0] * s + b.p[0] * t, a.p[1] * s + b.p[1] * t, a.p[2] * s + b.p[2] * t, a.p[3] * s + b.p[3] * t);
+        out.normal = vec4(a.normal[0] * s + b.normal[0] * t, a.normal[1] * s + b.normal[1] * t, a.normal[2] * s + b.normal[2] * t, 0.f);
+        out.normal.normalise();
+        out.rgb = colour(a.rgb[colour::RED] * s + b.rgb[colour::RED] * t,
+            a.rgb[colour::GREEN] * s + b.rgb[colour::GREEN] * t,
+            a.rgb[colour::BLUE] * s + b.rgb[colour::BLUE] * t);
+    }
+};
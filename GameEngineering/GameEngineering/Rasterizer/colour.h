@@ -2,6 +2,7 @@
 
 #include <cmath>
 #include <cstdint>
+#include "platform.h"
 
 // The `colour` class represents an RGB colour with floating-point precision.
 // It provides various utilities for manipulating and converting colours.
@@ -25,6 +26,9 @@ public:
     // - _b: Blue component (default 0.0f)
     colour(float _r = 0, float _g = 0, float _b = 0) : r(_r), g(_g), b(_b) {}
 
+    // Copies are plain member copies, declared because operator= below is user-written
+    colour(const colour&) = default;
+
     // Sets the RGB components of the colour.
     // Input Variables:
     // - _r: Red component
@@ -38,6 +42,9 @@ public:
     // Returns a reference to the specified component.
     float& operator[] (Colour c) { return rgb[c]; }
 
+    // Reads a colour component by index (const version)
+    float operator[] (Colour c) const { return rgb[c]; }
+
     // Assigns the values of another colour to this one.
     // Input Variables:
     // - c: The source color
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "platform.h"
+#include "threadPool.h"
+
+// Bump allocator for data that only lives for a frame, such as triangle setups and bin lists.
+// Allocating moves an offset through a block taken from the heap, and nothing is freed until
+// reset() rewinds the whole arena at once. When a frame outgrows the arena more blocks are
+// added, and the next reset merges them into one block big enough for all of them, so once
+// the renderer has warmed up a frame takes no memory from the heap.
+class FrameArena {
+    static const size_t minBlockSize = 1 << 20; // Smallest block taken from the heap
+    static const size_t blockAlignment = 64;    // Alignment of every block, one cache line
+
+    struct Block {
+        char* data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks; // Blocks in the order they are filled
+    size_t current = 0;        // Block allocations are taken from
+    size_t offset = 0;         // Bytes used in the current block
+
+    static char* allocateBlock(size_t size) {
+        return static_cast<char*>(::operator new[](size, std::align_val_t(blockAlignment)));
+    }
+
+    void release() {
+        for (Block& block : blocks)
+            ::operator delete[](block.data, std::align_val_t(blockAlignment));
+        blocks.clear();
+    }
+
+public:
+    FrameArena() {}
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+    ~FrameArena() { release(); }
+
+    // Takes memory from the arena, valid until the next reset
+    // Input Variables:
+    // - bytes: Size of the allocation
+    // - alignment: Alignment of the allocation, a power of two no larger than a cache line
+    // Returns the start of the allocation
+    void* allocate(size_t bytes, size_t alignment) {
+        for (; current < blocks.size(); current++, offset = 0) {
+            size_t start = (offset + alignment - 1) & ~(alignment - 1);
+            if (start + bytes <= blocks[current].size) {
+                offset = start + bytes;
+                return blocks[current].data + start;
+            }
+        }
+
+        // Out of space: add a block, at least as large as everything allocated so far
+        size_t size = max(minBlockSize, bytes);
+        for (const Block& block : blocks)
+            size = max(size, block.size);
+        blocks.push_back({ allocateBlock(size), size });
+        current = blocks.size() - 1;
+        offset = bytes;
+        return blocks[current].data;
+    }
+
+    // Grows the most recent allocation in place when its block has room
+    // Input Variables:
+    // - data: Start of the allocation
+    // - bytes: Its current size
+    // - newBytes: Size wanted
+    // Returns true if the allocation now has newBytes, false if it was left as it was
+    bool extend(void* data, size_t bytes, size_t newBytes) {
+        if (current >= blocks.size()) return false;
+        const Block& block = blocks[current];
+        char* end = static_cast<char*>(data) + bytes;
+        if (end != block.data + offset || offset - bytes + newBytes > block.size) return false;
+        offset += newBytes - bytes;
+        return true;
+    }
+
+    // Frees everything allocated from the arena. Blocks are kept for the next frame, merged
+    // into one when a frame needed more than one.
+    void reset() {
+        if (blocks.size() > 1) {
+            size_t total = 0;
+            for (const Block& block : blocks)
+                total += block.size;
+            release();
+            blocks.push_back({ allocateBlock(total), total });
+        }
+        current = 0;
+        offset = 0;
+    }
+
+    // Returns the number of bytes the arena holds, in use or not
+    size_t capacity() const {
+        size_t total = 0;
+        for (const Block& block : blocks)
+            total += block.size;
+        return total;
+    }
+};
+
+// Frame arenas of every pool thread. Each thread allocates from its own arena, so the
+// transform and binning tasks never contend for the heap. Every thread has two arenas used on
+// alternate frames: beginFrame resets only the one for the new frame, so what was allocated
+// during the last frame stays valid while the next one is built.
+class FrameArenas {
+    // Arenas of one thread, padded so threads never share a cache line
+    struct alignas(64) ThreadArenas {
+        FrameArena arenas[2];
+    };
+
+    std::vector<ThreadArenas> threads;
+    unsigned int frame = 0; // Which of the two arenas of every thread is in use
+
+    FrameArenas() : threads(ThreadPool::getInstance().threadCount()) {}
+
+public:
+    FrameArenas(const FrameArenas&) = delete;
+    FrameArenas& operator=(const FrameArenas&) = delete;
+
+    // Get the shared arenas, created on first use
+    static FrameArenas& getInstance() {
+        static FrameArenas instance;
+        return instance;
+    }
+
+    // Switches every thread to its other arena and empties it, call while the pool is idle
+    void beginFrame() {
+        frame ^= 1;
+        for (ThreadArenas& thread : threads)
+            thread.arenas[frame].reset();
+    }
+
+    // Arena of the calling thread for the current frame, for pool threads and the thread that submits work
+    FrameArena& local() {
+        return threads[ThreadPool::workerIndex()].arenas[frame];
+    }
+
+    // Returns the number of bytes held by all arenas
+    size_t capacity() const {
+        size_t total = 0;
+        for (const ThreadArenas& thread : threads)
+            total += thread.arenas[0].capacity() + thread.arenas[1].capacity();
+        return total;
+    }
+};
+
+// Growable array of plain data kept in the frame arena of the thread that fills it.
+// Growing doubles the capacity, in place when the array holds the arena's latest allocation,
+// otherwise by copying to a new allocation and leaving the old one until the arena is reset.
+// The storage belongs to a frame: an array kept across frames must be reset before it is
+// used again.
+template <typename T>
+class ArenaArray {
+    static_assert(std::is_trivially_copy_constructible_v<T> && std::is_trivially_destructible_v<T>,
+        "ArenaArray copies elements bytewise and never destroys them");
+
+    static const size_t initialCapacity = 16;
+
+    T* items = nullptr;
+    size_t count = 0;
+    size_t allocated = 0;
+
+    // Moves the elements to storage for capacity elements
+    void grow(size_t capacity) {
+        FrameArena& arena = FrameArenas::getInstance().local();
+        if (items && arena.extend(items, allocated * sizeof(T), capacity * sizeof(T))) {
+            allocated = capacity;
+            return;
+        }
+        T* grown = static_cast<T*>(arena.allocate(capacity * sizeof(T), alignof(T)));
+        std::uninitialized_copy(items, items + count, grown);
+        items = grown;
+        allocated = capacity;
+    }
+
+public:
+    // Forgets the storage, for arrays kept from one frame to the next
+    void reset() {
+        items = nullptr;
+        count = allocated = 0;
+    }
+
+    // Empties the array, keeping its storage for the rest of the frame
+    void clear() { count = 0; }
+
+    // Makes room for n elements, so the array does not grow until it holds more
+    // Input Variables:
+    // - n: Number of elements to make room for
+    void reserve(size_t n) {
+        if (n > allocated) grow(n);
+    }
+
+    // Changes the number of elements, new elements are left uninitialised
+    // Input Variables:
+    // - n: New number of elements
+    void resize(size_t n) {
+        if (n > allocated) grow(n);
+        count = n;
+    }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (count == allocated) grow(allocated ? allocated * 2 : initialCapacity);
+        return *new (items + count++) T(std::forward<Args>(args)...);
+    }
+
+    void push_back(const T& item) { emplace_back(item); }
+    void pop_back() { count--; }
+
+    void swap(ArenaArray& other) {
+        std::swap(items, other.items);
+        std::swap(count, other.count);
+        std::swap(allocated, other.allocated);
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+    T& back() { return items[count - 1]; }
+
+    T* begin() { return items; }
+    T* end() { return items + count; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cmath>
+#include "vec4.h"
+#include "matrix.h"
+
+// Result of testing a volume against the view frustum
+enum class Visibility { Outside, Intersecting, Inside };
+
+// The six planes of a view frustum in world space.
+// Each plane is stored as (a, b, c, d) with a unit normal pointing into the frustum,
+// so a point p is on the inside when a*x + b*y + c*z + d >= 0.
+class Frustum {
+public:
+    static const unsigned int allPlanes = 0x3f; // Mask selecting all six planes
+
+    vec4 planes[6]; // Left, right, bottom, top, near, far
+
+    // Extracts the planes from a combined projection and view matrix (Gribb-Hartmann).
+    // Uses the projection's 0 <= z <= w depth convention, see matrix::makePerspective.
+    // Input Variables:
+    // - m: perspective * camera, planes come out in the space the matrix is applied to
+    // Returns the frustum
+    static Frustum fromMatrix(const matrix& m) {
+        Frustum f;
+        for (unsigned int i = 0; i < 4; i++) {
+            f.planes[0][i] = m(3, i) + m(0, i); // Left:   -w <= x
+            f.planes[1][i] = m(3, i) - m(0, i); // Right:   x <= w
+            f.planes[2][i] = m(3, i) + m(1, i); // Bottom: -w <= y
+            f.planes[3][i] = m(3, i) - m(1, i); // Top:     y <= w
+            f.planes[4][i] = m(2, i);           // Near:    0 <= z
+            f.planes[5][i] = m(3, i) - m(2, i); // Far:     z <= w
+        }
+
+        // Normalise so plane equations give true distances, needed for sphere tests
+        for (vec4& p : f.planes) {
+            float length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            p = p * (1.f / length);
+        }
+        return f;
+    }
+
+    // Tests a sphere against the frustum
+    // Input Variables:
+    // - center: Sphere center in world space
+    // - radius: Sphere radius
+    // - mask: Bit i set if plane i needs testing
+    // Returns whether the sphere is fully outside, straddles a plane, or is fully inside
+    Visibility testSphere(const vec4& center, float radius, unsigned int mask = allPlanes) const {
+        Visibility result = Visibility::Inside;
+        for (unsigned int i = 0; i < 6; i++) {
+            if (!(mask & (1u << i))) continue;
+            const vec4& p = planes[i];
+            float d = p[0] * center[0] + p[1] * center[1] + p[2] * center[2] + p[3];
+            if (d < -radius) return Visibility::Outside;
+            if (d < radius) result = Visibility::Intersecting;
+        }
+        return result;
+    }
+
+    // Tests an axis-aligned box against the frustum.
+    // Planes the box is fully inside of are removed from the mask, so the children of a box
+    // only need testing against the planes their parent straddled.
+    // Input Variables:
+    // - minV, maxV: Opposite corners of the box in world space
+    // - mask: Bit i set if plane i still needs testing, updated on return
+    // Returns whether the box is fully outside, straddles a plane, or is fully inside
+    Visibility testBox(const vec4& minV, const vec4& maxV, unsigned int& mask) const {
+        for (unsigned int i = 0; i < 6; i++) {
+            if (!(mask & (1u << i))) continue;
+            const vec4& p = planes[i];
+
+            // Corners furthest along and against the plane normal
+            float px = p[0] >= 0.f ? maxV[0] : minV[0], nx = p[0] >= 0.f ? minV[0] : maxV[0];
+            float py = p[1] >= 0.f ? maxV[1] : minV[1], ny = p[1] >= 0.f ? minV[1] : maxV[1];
+            float pz = p[2] >= 0.f ? maxV[2] : minV[2], nz = p[2] >= 0.f ? minV[2] : maxV[2];
+
+            if (p[0] * px + p[1] * py + p[2] * pz + p[3] < 0.f) return Visibility::Outside;
+            if (p[0] * nx + p[1] * ny + p[2] * nz + p[3] >= 0.f) mask &= ~(1u << i);
+        }
+        return mask ? Visibility::Intersecting : Visibility::Inside;
+    }
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "matrix.h"
+#include "mesh.h"
+
+// Per-instance data of an instanced mesh, everything else comes from the shared geometry
+struct Instance {
+    matrix world;     // Transformation matrix of this instance
+    float ka;         // Ambient reflection coefficient
+    float kd;         // Diffuse reflection coefficient
+};
+
+// Many copies of one mesh: a single immutable, reference-counted geometry plus a compact
+// array of instances. Only the instances are touched per object, and every instance reads
+// the same vertex streams, which stay in cache while the instances are transformed.
+class InstancedMesh {
+public:
+    std::shared_ptr<const Mesh> geometry; // Shared vertices, triangles and bounds, its world matrix is ignored
+    std::vector<Instance> instances;      // One entry per copy drawn
+
+    // Constructor sharing existing geometry, e.g. between several instanced meshes
+    // Input Variables:
+    // - _geometry: Geometry to draw, its vertex streams must be built (Mesh::updateStreams)
+    InstancedMesh(std::shared_ptr<const Mesh> _geometry) : geometry(std::move(_geometry)) {}
+
+    // Constructor taking a copy of a mesh as the shared geometry
+    // Input Variables:
+    // - mesh: Mesh to instance, e.g. the result of Mesh::makeCube
+    InstancedMesh(const Mesh& mesh) {
+        std::shared_ptr<Mesh> copy = std::make_shared<Mesh>(mesh);
+        copy->refreshStreams();
+        geometry = std::move(copy);
+    }
+
+    // Adds an instance with the geometry's material
+    // Input Variables:
+    // - world: Transformation matrix of the new instance
+    // Returns the index of the instance
+    size_t add(const matrix& world) {
+        instances.push_back({ world, geometry->ka, geometry->kd });
+        return instances.size() - 1;
+    }
+};
+
+// One object handed to the renderer: which geometry to draw, where, and with which material.
+// Plain meshes and instances are both turned into draw items so the pipeline handles them alike.
+struct DrawItem {
+    const Mesh* geometry;  // Vertices, triangles and bounds to draw
+    const matrix* world;   // Transformation matrix, owned by the mesh or instance
+    float ka, kd;          // Ambient and diffuse reflection coefficients
+    bool occluder;         // Hides other items in the occlusion buffer, from Mesh::occluder
+
+    bool operator==(const DrawItem& other) const {
+        return geometry == other.geometry && world == other.world;
+    }
+
+    // Collects the draw items of a scene. Meshes come first, then each instanced mesh with
+    // its instances kept together, so instances sharing geometry are processed back to back.
+    // Input Variables:
+    // - meshes: Individually allocated meshes
+    // - instanced: Instanced meshes
+    // Output Variables:
+    // - items: Receives one draw item per mesh and per instance
+    static void gather(std::vector<Mesh*>& meshes, std::vector<InstancedMesh*>& instanced, std::vector<DrawItem>& items) {
+        items.clear();
+        for (Mesh* mesh : meshes) {
+            mesh->refreshStreams();
+            items.push_back({ mesh, &mesh->world, mesh->ka, mesh->kd, mesh->occluder });
+        }
+        for (InstancedMesh* group : instanced)
+            for (const Instance& instance : group->instances)
+                items.push_back({ group->geometry.get(), &instance.world, instance.ka, instance.kd, group->geometry->occluder });
+    }
+};
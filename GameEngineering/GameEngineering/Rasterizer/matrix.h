@@ -2,15 +2,64 @@
 
 #include <iostream>
 #include <vector>
+#include "platform.h"
 #include "vec4.h"
 
 // Matrix class for 4x4 transformation matrices
+// Rows share storage with SSE registers. Products broadcast one element at a time and sum
+// whole rows (or columns), keeping the order of the scalar formulas in every lane.
 class matrix {
     union {
-        float m[4][4]; // 2D array representation of the matrix
-        float a[16];   // 1D array representation of the matrix for linear access
+        float m[4][4];   // 2D array representation of the matrix
+        float a[16];     // 1D array representation of the matrix for linear access
+        __m128 rows[4];  // SSE register representation of the rows
     };
 
+    // Constructor from four rows, used by the products so they skip the identity
+    matrix(__m128 r0, __m128 r1, __m128 r2, __m128 r3) {
+        rows[0] = r0;
+        rows[1] = r1;
+        rows[2] = r2;
+        rows[3] = r3;
+    }
+
+    // Lane mask keeping the w component of a row
+    static __m128 maskW() { return _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1)); }
+
+    // Sums the rows of mx weighted by the elements of row, in order
+    static __m128 combineRows(const float* row, const matrix& mx) {
+        __m128 r = _mm_mul_ps(_mm_set1_ps(row[0]), mx.rows[0]);
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(row[1]), mx.rows[1]));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(row[2]), mx.rows[2]));
+        return _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(row[3]), mx.rows[3]));
+    }
+
+    // Sums the first three rows of mx weighted by the elements of row, then adds the row's w.
+    // For an affine mx this is combineRows: its last row only contributes w.
+    static __m128 combineRowsAffine(const float* row, __m128 original, const matrix& mx) {
+        __m128 r = _mm_mul_ps(_mm_set1_ps(row[0]), mx.rows[0]);
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(row[1]), mx.rows[1]));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(row[2]), mx.rows[2]));
+        return _mm_add_ps(r, _mm_and_ps(original, maskW()));
+    }
+
+    // Transforms one point by the matrix given as its columns
+    static __m128 transformByColumns(const __m128 columns[4], __m128 v) {
+        __m128 r = _mm_mul_ps(columns[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+        r = _mm_add_ps(r, _mm_mul_ps(columns[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+        r = _mm_add_ps(r, _mm_mul_ps(columns[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+        return _mm_add_ps(r, _mm_mul_ps(columns[3], _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+    }
+
+    // Copies the columns of the matrix into registers
+    void getColumns(__m128 columns[4]) const {
+        columns[0] = rows[0];
+        columns[1] = rows[1];
+        columns[2] = rows[2];
+        columns[3] = rows[3];
+        _MM_TRANSPOSE4_PS(columns[0], columns[1], columns[2], columns[3]);
+    }
+
 public:
     // Default constructor initializes the matrix as an identity matrix
     matrix() {
@@ -20,6 +69,9 @@ public:
     // Access matrix elements by row and column
     float& operator()(unsigned int row, unsigned int col) { return m[row][col]; }
 
+    // Read matrix elements by row and column (const version)
+    float operator()(unsigned int row, unsigned int col) const { return m[row][col]; }
+
     // Display the matrix elements in a readable format
     void display() {
         for (unsigned int i = 0; i < 4; i++) {
@@ -34,12 +86,22 @@ public:
     // - v: vec4 object to multiply with the matrix
     // Returns the resulting transformed vec4
     vec4 operator * (const vec4& v) const {
-        vec4 result;
-        result[0] = a[0] * v[0] + a[1] * v[1] + a[2] * v[2] + a[3] * v[3];
-        result[1] = a[4] * v[0] + a[5] * v[1] + a[6] * v[2] + a[7] * v[3];
-        result[2] = a[8] * v[0] + a[9] * v[1] + a[10] * v[2] + a[11] * v[3];
-        result[3] = a[12] * v[0] + a[13] * v[1] + a[14] * v[2] + a[15] * v[3];
-        return result;
+        __m128 columns[4];
+        getColumns(columns);
+        return vec4(transformByColumns(columns, v.simd()));
+    }
+
+    // Multiply many 4D vectors by the matrix, transposing it once for all of them
+    // Input Variables:
+    // - in: Vectors to transform
+    // - count: Number of vectors
+    // Output Variables:
+    // - out: Transformed vectors, the same as operator * gives for each, may be in
+    void transformPoints(const vec4* in, vec4* out, size_t count) const {
+        __m128 columns[4];
+        getColumns(columns);
+        for (size_t i = 0; i < count; i++)
+            out[i] = vec4(transformByColumns(columns, in[i].simd()));
     }
 
     // Multiply the matrix by another matrix
@@ -47,19 +109,55 @@ public:
     // - mx: Another matrix to multiply with
     // Returns the resulting matrix
     matrix operator * (const matrix& mx) const {
-        matrix ret;
-        for (int row = 0; row < 4; ++row) {
-            for (int col = 0; col < 4; ++col) {
-                ret.a[row * 4 + col] =
-                    a[row * 4 + 0] * mx.a[0 * 4 + col] +
-                    a[row * 4 + 1] * mx.a[1 * 4 + col] +
-                    a[row * 4 + 2] * mx.a[2 * 4 + col] +
-                    a[row * 4 + 3] * mx.a[3 * 4 + col];
-            }
-        }
-        return ret;
+        return matrix(combineRows(m[0], mx), combineRows(m[1], mx), combineRows(m[2], mx), combineRows(m[3], mx));
     }
 
+    // Multiply two affine matrices (last row 0, 0, 0, 1), such as the products of translations,
+    // rotations and scales that place objects in the world. Skips the last row and the terms
+    // it would contribute, and gives the same result as operator * for affine matrices.
+    // Input Variables:
+    // - mx: Another affine matrix to multiply with
+    // Returns the resulting affine matrix
+    matrix multiplyAffine(const matrix& mx) const {
+        return matrix(combineRowsAffine(m[0], rows[0], mx), combineRowsAffine(m[1], rows[1], mx),
+            combineRowsAffine(m[2], rows[2], mx), _mm_setr_ps(0.f, 0.f, 0.f, 1.f));
+    }
+
+    // Invert an affine matrix (last row 0, 0, 0, 1). The upper 3x3 is inverted through its
+    // adjugate, so it may hold any non-uniform scale, and the translation is carried over.
+    // Returns the inverse matrix
+    matrix inverseAffine() const {
+        // Columns of the adjugate of the 3x3 with rows r0, r1, r2 are r1 x r2, r2 x r0 and r0 x r1
+        vec4 r0(rows[0]), r1(rows[1]), r2(rows[2]);
+        r0[3] = r1[3] = r2[3] = 0.f;
+        vec4 c0 = vec4::cross(r1, r2);
+        vec4 c1 = vec4::cross(r2, r0);
+        vec4 c2 = vec4::cross(r0, r1);
+        __m128 invDet = _mm_set1_ps(1.f / vec4::dot(r0, c0));
+
+        // The inverse translation is minus the inverse 3x3 applied to the translation
+        __m128 columns[4] = { _mm_mul_ps(c0.simd(), invDet), _mm_mul_ps(c1.simd(), invDet), _mm_mul_ps(c2.simd(), invDet), _mm_setzero_ps() };
+        __m128 t = _mm_mul_ps(columns[0], _mm_set1_ps(m[0][3]));
+        t = _mm_add_ps(t, _mm_mul_ps(columns[1], _mm_set1_ps(m[1][3])));
+        t = _mm_add_ps(t, _mm_mul_ps(columns[2], _mm_set1_ps(m[2][3])));
+        columns[3] = _mm_sub_ps(_mm_setzero_ps(), t);
+
+        _MM_TRANSPOSE4_PS(columns[0], columns[1], columns[2], columns[3]);
+        return matrix(columns[0], columns[1], columns[2], _mm_setr_ps(0.f, 0.f, 0.f, 1.f));
+    }
+
+    // Compare two matrices element by element
+    // Input Variables:
+    // - mx: Matrix to compare with
+    // Returns true if every element is equal
+    bool operator == (const matrix& mx) const {
+        __m128 equal = _mm_and_ps(_mm_and_ps(_mm_cmpeq_ps(rows[0], mx.rows[0]), _mm_cmpeq_ps(rows[1], mx.rows[1])),
+            _mm_and_ps(_mm_cmpeq_ps(rows[2], mx.rows[2]), _mm_cmpeq_ps(rows[3], mx.rows[3])));
+        return _mm_movemask_ps(equal) == 0xF;
+    }
+
+    bool operator != (const matrix& mx) const { return !(*this == mx); }
+
     // Create a perspective projection matrix
     // Input Variables:
     // - fov: Field of view in radians
@@ -135,12 +233,30 @@ public:
         return m;
     }
 
-    // Create a composite rotation matrix from X, Y, and Z rotations
+    // Create a composite rotation matrix from X, Y, and Z rotations, equal to
+    // makeRotateX(x) * makeRotateY(y) * makeRotateZ(z) but written out in closed form, so the
+    // sines and cosines are taken once and the products of zeros are skipped
     // Input Variables:
     // - x, y, z: Rotation angles in radians around each axis
     // Returns the composite rotation matrix
     static matrix makeRotateXYZ(float x, float y, float z) {
-        return matrix::makeRotateX(x) * matrix::makeRotateY(y) * matrix::makeRotateZ(z);
+        float cx = std::cos(x), sx = std::sin(x);
+        float cy = std::cos(y), sy = std::sin(y);
+        float cz = std::cos(z), sz = std::sin(z);
+
+        // Rows of makeRotateX(x) * makeRotateY(y), rotated about Z below
+        float sxsy = sx * sy, cxsy = cx * sy;
+        matrix m;
+        m.a[0] = cy * cz;
+        m.a[1] = -(cy * sz);
+        m.a[2] = sy;
+        m.a[4] = sxsy * cz + cx * sz;
+        m.a[5] = cx * cz - sxsy * sz;
+        m.a[6] = -(sx * cy);
+        m.a[8] = sx * sz - cxsy * cz;
+        m.a[9] = cxsy * sz + sx * cz;
+        m.a[10] = cx * cy;
+        return m;
     }
 
     // Create a scaling matrix
@@ -172,17 +288,16 @@ public:
 private:
     // Set all elements of the matrix to 0
     void zero() {
-        for (unsigned int i = 0; i < 16; i++)
-            a[i] = 0.f;
+        for (__m128& row : rows)
+            row = _mm_setzero_ps();
     }
 
     // Set the matrix as an identity matrix
     void identity() {
-        for (int i = 0; i < 4; ++i) {
-            for (int j = 0; j < 4; ++j) {
-                m[i][j] = (i == j) ? 1.0f : 0.0f;
-            }
-        }
+        rows[0] = _mm_setr_ps(1.f, 0.f, 0.f, 0.f);
+        rows[1] = _mm_setr_ps(0.f, 1.f, 0.f, 0.f);
+        rows[2] = _mm_setr_ps(0.f, 0.f, 1.f, 0.f);
+        rows[3] = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
     }
 };
 
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cmath>
+#include <iostream>
+#include "platform.h"
+#include "matrix.h"
+
+// Headless check of the matrix shortcuts against the general operations they stand in for.
+// makeRotateXYZ and multiplyAffine promise the same bits as the products they replace, so those
+// are compared exactly. inverseAffine goes through the adjugate rather than elimination, so it is
+// compared within float rounding against a double-precision Gauss-Jordan inverse, and its product
+// with the original, taken in double, against the identity.
+
+// Inverts a matrix by Gauss-Jordan elimination with partial pivoting, in double precision
+// Input Variables:
+// - mx: Matrix to invert
+// Output Variables:
+// - inverse: Inverse of mx, row by row
+// Returns false if mx is singular
+inline bool referenceInverse(const matrix& mx, double inverse[4][4]) {
+    double work[4][8];
+    for (unsigned int r = 0; r < 4; r++) {
+        for (unsigned int c = 0; c < 4; c++) {
+            work[r][c] = mx(r, c);
+            work[r][c + 4] = r == c ? 1.0 : 0.0;
+        }
+    }
+
+    for (unsigned int c = 0; c < 4; c++) {
+        unsigned int pivot = c;
+        for (unsigned int r = c + 1; r < 4; r++)
+            if (std::fabs(work[r][c]) > std::fabs(work[pivot][c])) pivot = r;
+        if (work[pivot][c] == 0.0) return false;
+        for (unsigned int k = 0; k < 8; k++) std::swap(work[c][k], work[pivot][k]);
+
+        double scale = 1.0 / work[c][c];
+        for (unsigned int k = 0; k < 8; k++) work[c][k] *= scale;
+        for (unsigned int r = 0; r < 4; r++) {
+            if (r == c) continue;
+            double factor = work[r][c];
+            for (unsigned int k = 0; k < 8; k++) work[r][k] -= factor * work[c][k];
+        }
+    }
+
+    for (unsigned int r = 0; r < 4; r++)
+        for (unsigned int c = 0; c < 4; c++)
+            inverse[r][c] = work[r][c + 4];
+    return true;
+}
+
+// Runs the matrix checks and writes one line per check
+// Input Variables:
+// - os: Stream the results are written to
+// Returns the number of checks that failed
+inline unsigned int checkMatrixHelpers(std::ostream& os) {
+    const int samples = 10000;
+    unsigned int rotateMismatches = 0, affineMismatches = 0, inverseMismatches = 0;
+    double inverseError = 0.0, identityError = 0.0;
+
+    for (int i = 0; i < samples; i++) {
+        // Angles sweep several turns in both directions, translations and scales a wide range
+        float x = i * 0.0137f - 68.f, y = i * -0.0071f + 35.f, z = i * 0.0023f - 11.f;
+        matrix rotation = matrix::makeRotateXYZ(x, y, z);
+        if (rotation != matrix::makeRotateX(x) * matrix::makeRotateY(y) * matrix::makeRotateZ(z))
+            rotateMismatches++;
+
+        matrix scale;
+        scale(0, 0) = 0.05f + (i % 97) * 0.5f;
+        scale(1, 1) = 0.05f + (i % 89) * 0.25f;
+        scale(2, 2) = 0.05f + (i % 83) * 0.75f;
+        matrix world = matrix::makeTranslation(x * 10.f, y * -20.f, z * 30.f) * rotation * scale;
+        matrix other = matrix::makeTranslation(z, x, y) * matrix::makeRotateXYZ(z, x, y);
+        if (world.multiplyAffine(other) != world * other || other.multiplyAffine(world) != other * world)
+            affineMismatches++;
+
+        // Errors are relative to the size of the elements compared
+        double reference[4][4];
+        if (!referenceInverse(world, reference)) {
+            inverseMismatches++;
+            continue;
+        }
+        matrix inverse = world.inverseAffine();
+        double size = 0.0;
+        for (unsigned int r = 0; r < 4; r++)
+            for (unsigned int c = 0; c < 4; c++)
+                size = max(size, std::fabs(reference[r][c]));
+        double worstInverse = 0.0, worstIdentity = 0.0;
+        for (unsigned int r = 0; r < 4; r++) {
+            for (unsigned int c = 0; c < 4; c++) {
+                worstInverse = max(worstInverse, std::fabs(inverse(r, c) - reference[r][c]) / size);
+                // The product is taken in double, so only the inverse's own rounding shows, and
+                // compared relative to its terms, which cancel for the translation column
+                double product = 0.0, terms = 0.0;
+                for (unsigned int k = 0; k < 4; k++) {
+                    product += (double)world(r, k) * inverse(k, c);
+                    terms += std::fabs((double)world(r, k) * inverse(k, c));
+                }
+                worstIdentity = max(worstIdentity, std::fabs(product - (r == c ? 1.0 : 0.0)) / max(terms, 1.0));
+            }
+        }
+        if (worstInverse > 1e-5 || worstIdentity > 1e-5) inverseMismatches++;
+        inverseError = max(inverseError, worstInverse);
+        identityError = max(identityError, worstIdentity);
+    }
+
+    unsigned int failures = 0;
+    auto report = [&](const char* name, unsigned int mismatches) {
+        os << name << ", " << samples << " matrices: ";
+        if (mismatches == 0) {
+            os << "ok\n";
+        }
+        else {
+            os << mismatches << " mismatches\n";
+            failures++;
+        }
+    };
+    report("makeRotateXYZ equals makeRotateX * makeRotateY * makeRotateZ", rotateMismatches);
+    report("multiplyAffine equals operator *", affineMismatches);
+    report("inverseAffine matches the reference inverse", inverseMismatches);
+    os << "inverseAffine largest error " << inverseError << " relative, " << identityError << " relative from identity\n";
+    return failures;
+}
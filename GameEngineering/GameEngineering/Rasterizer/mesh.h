@@ -1,10 +1,13 @@
 ﻿#pragma once
 
 #include <vector>
+#include <cfloat>
+#include <cmath>
 #include <iostream>
 #include "vec4.h"
 #include "matrix.h"
 #include "colour.h"
+#include "alignedArray.h"
 
 // Represents a vertex in a 3D mesh, including its position, normal, and color
 struct Vertex {
@@ -13,6 +16,18 @@ struct Vertex {
     colour rgb;     // Color of the vertex
 };
 
+// Vertex data split into one array per component (structure of arrays).
+// Built from Mesh::vertices so batched SIMD kernels can load 8 vertices with a single
+// aligned load per component instead of picking them out of interleaved Vertex structs.
+struct VertexStreams {
+    AlignedArray<float> px, py, pz; // Positions, w is implicitly 1
+    AlignedArray<float> nx, ny, nz; // Normals, w is implicitly 0
+    AlignedArray<float> r, g, b;    // Colours
+
+    // Number of vertices in the streams
+    size_t size() const { return px.size(); }
+};
+
 // Stores indices of vertices that form a triangle in a mesh
 struct triIndices {
     unsigned int v[3]; // Indices into the vertex array
@@ -34,6 +49,9 @@ public:
     matrix world;     // Transformation matrix for the mesh
     std::vector<Vertex> vertices;       // List of vertices in the mesh
     std::vector<triIndices> triangles;  // List of triangles in the mesh
+    VertexStreams streams;              // Structure-of-arrays copy of the vertices, see updateStreams
+    bool streamsStale = false;          // Vertices changed since the streams were built, see verticesChanged
+    bool occluder = false;              // Drawn into the occlusion buffer first, to cull what it hides
 
 
     vec4 boundingCenter;
@@ -64,6 +82,14 @@ public:
     void addVertex(const vec4& vertex, const vec4& normal) {
         Vertex v = { vertex, normal, col };
         vertices.push_back(v);
+        streamsStale = true;
+    }
+
+    // Marks the streams as out of date after the vertex list was edited directly, e.g. vertices
+    // moved or recoloured in place. The renderer only reads the streams, so edits made without
+    // this call (or updateStreams) are not drawn.
+    void verticesChanged() {
+        streamsStale = true;
     }
 
     // Add a triangle to the mesh
@@ -128,6 +154,66 @@ public:
         }
         boundingRadius = std::sqrt(maxDistSqr);
     }
+
+    // Bounding sphere transformed by the world matrix
+    // Output Variables:
+    // - center: Sphere center in world space
+    // - radius: Sphere radius, scaled by the largest axis scale of the world matrix
+    void getWorldBounds(vec4& center, float& radius) const
+    {
+        getWorldBounds(world, center, radius);
+    }
+
+    // Bounding sphere transformed by another matrix, e.g. that of an instance sharing this geometry
+    // Input Variables:
+    // - transform: Matrix to apply
+    // Output Variables:
+    // - center: Transformed sphere center
+    // - radius: Sphere radius, scaled by the largest axis scale of the matrix
+    void getWorldBounds(const matrix& transform, vec4& center, float& radius) const
+    {
+        center = transform * boundingCenter;
+
+        float scale = 0.f;
+        for (unsigned int col = 0; col < 3; col++) {
+            float x = transform(0, col), y = transform(1, col), z = transform(2, col);
+            scale = max(scale, x * x + y * y + z * z);
+        }
+        radius = boundingRadius * std::sqrt(scale);
+    }
+
+    // Rebuild the structure-of-arrays copy of the vertices used by the batched transform.
+    // Must be called after the vertex list changes; the factory functions do this already.
+    void updateStreams()
+    {
+        size_t n = vertices.size();
+        AlignedArray<float>* arrays[] = { &streams.px, &streams.py, &streams.pz, &streams.nx, &streams.ny, &streams.nz, &streams.r, &streams.g, &streams.b };
+        for (AlignedArray<float>* a : arrays)
+            a->resize(n);
+
+        for (size_t i = 0; i < n; i++) {
+            Vertex& v = vertices[i];
+            streams.px[i] = v.p[0];
+            streams.py[i] = v.p[1];
+            streams.pz[i] = v.p[2];
+            streams.nx[i] = v.normal[0];
+            streams.ny[i] = v.normal[1];
+            streams.nz[i] = v.normal[2];
+            streams.r[i] = v.rgb[colour::RED];
+            streams.g[i] = v.rgb[colour::GREEN];
+            streams.b[i] = v.rgb[colour::BLUE];
+        }
+        streamsStale = false;
+    }
+
+    // Rebuild the streams if the vertices changed since they were last built, through addVertex
+    // or verticesChanged. A vertex list resized directly is caught too.
+    void refreshStreams()
+    {
+        if (streamsStale || streams.size() != vertices.size())
+            updateStreams();
+    }
+
     // Create a rectangle mesh given two opposite corners
     // Input Variables:
     // - x1, y1: Coordinates of one corner
@@ -160,6 +246,7 @@ public:
         mesh.addTriangle(0, 2, 1);
         mesh.addTriangle(0, 3, 2);
         mesh.updateBounds();
+        mesh.updateStreams();
         return mesh;
     }
 
@@ -221,6 +308,7 @@ public:
             mesh.addTriangle(baseIndex, baseIndex + 3, baseIndex + 2);
         }
         mesh.updateBounds();
+        mesh.updateStreams();
         return mesh;
     } 
 
@@ -278,6 +366,7 @@ public:
             }
         }
         mesh.updateBounds();
+        mesh.updateStreams();
         return mesh;
     }
 };
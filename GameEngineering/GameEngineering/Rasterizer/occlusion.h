@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "matrix.h"
+#include "platform.h"
+#include "vec4.h"
+
+// Low-resolution software occlusion buffer for culling whole draw items before they are transformed.
+// Chosen occluders are rasterized into it first, then the screen-space bounding box of every other
+// item is tested against it in one pass over the tiles the box touches.
+//
+// The buffer covers the screen at 1 / scale resolution in tiles of 8 x 8 occlusion pixels. Instead
+// of a depth per pixel every tile keeps a coverage mask and two conservative depths (masked
+// occlusion culling):
+// - zMax0, the farthest depth anywhere in the tile
+// - zMax1, the farthest depth of the pixels set in the mask, a working layer of occluders
+//   that do not yet cover the whole tile
+// When the mask fills up, the working layer becomes the new zMax0. Occluders only set the bits of
+// pixels they cover completely, so an item found hidden is hidden in the full-resolution image too.
+class OcclusionBuffer {
+public:
+    static const int scale = 4;    // Screen pixels per occlusion pixel along each axis
+    static const int tileSize = 8; // Occlusion pixels along each side of a tile, one mask bit each
+
+private:
+    struct Tile {
+        uint64_t mask;   // Pixels of the working layer, bit y * tileSize + x
+        uint64_t outside; // Pixels past the edge of the buffer, treated as covered
+        float zMax0;     // Farthest depth in the tile
+        float zMax1;     // Farthest depth of the working layer
+    };
+
+    std::vector<Tile> tiles;
+    int width = 0, height = 0;     // Size in occlusion pixels
+    int tilesX = 0, tilesY = 0;
+    float screenWidth = 0.f, screenHeight = 0.f;
+
+    // Mask of the pixels x0..x1, y0..y1 (inclusive) of a tile
+    static uint64_t rectMask(int x0, int y0, int x1, int y1) {
+        uint64_t row = ((1ull << (x1 - x0 + 1)) - 1) << x0;
+        uint64_t mask = 0;
+        for (int y = y0; y <= y1; y++)
+            mask |= row << (y * tileSize);
+        return mask;
+    }
+
+public:
+    // Sets up the buffer for a screen size, keeping it when the size does not change
+    // Input Variables:
+    // - w, h: Screen dimensions in pixels
+    void resize(unsigned int w, unsigned int h) {
+        if ((float)w == screenWidth && (float)h == screenHeight) return;
+        screenWidth = (float)w;
+        screenHeight = (float)h;
+        width = (w + scale - 1) / scale;
+        height = (h + scale - 1) / scale;
+        tilesX = (width + tileSize - 1) / tileSize;
+        tilesY = (height + tileSize - 1) / tileSize;
+        tiles.assign(tilesX * tilesY, Tile());
+        for (int ty = 0; ty < tilesY; ty++) {
+            for (int tx = 0; tx < tilesX; tx++) {
+                int x1 = min(width - tx * tileSize, tileSize) - 1;
+                int y1 = min(height - ty * tileSize, tileSize) - 1;
+                tiles[ty * tilesX + tx].outside = ~rectMask(0, 0, x1, y1);
+            }
+        }
+        clear();
+    }
+
+    // Empties the buffer: every tile is as far as the far plane
+    void clear() {
+        for (Tile& tile : tiles) {
+            tile.mask = 0;
+            tile.zMax0 = 1.f;
+            tile.zMax1 = 0.f;
+        }
+    }
+
+    // Rasterizes an occluder triangle
+    // Input Variables:
+    // - p0, p1, p2: Screen-space positions with depth in z, as drawn by the renderer
+    void drawTriangle(const vec4& p0, const vec4& p1, const vec4& p2) {
+        // Positions in occlusion pixels
+        float x[3] = { p0[0] / scale, p1[0] / scale, p2[0] / scale };
+        float y[3] = { p0[1] / scale, p1[1] / scale, p2[1] / scale };
+
+        // Only front-facing triangles occlude, as only they are drawn
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+        if (area <= 0.f) return;
+
+        // Whole tiles are updated with the triangle's farthest depth
+        float zTri = max(p0[2], max(p1[2], p2[2]));
+
+        // Edge equations, moved inwards so they only pass pixels the triangle covers
+        // completely: a pixel is inside when its most exposed corner is
+        float edgeA[3], edgeB[3], edgeC[3];
+        for (int i = 0; i < 3; i++) {
+            int a = (i + 1) % 3, b = (i + 2) % 3;
+            edgeA[i] = y[a] - y[b];
+            edgeB[i] = x[b] - x[a];
+            edgeC[i] = -(edgeA[i] * x[a] + edgeB[i] * y[a]) + min(edgeA[i], 0.f) + min(edgeB[i], 0.f);
+        }
+
+        int minX = max((int)floor(min(x[0], min(x[1], x[2]))), 0);
+        int minY = max((int)floor(min(y[0], min(y[1], y[2]))), 0);
+        int maxX = min((int)ceil(max(x[0], max(x[1], x[2]))), width) - 1;
+        int maxY = min((int)ceil(max(y[0], max(y[1], y[2]))), height) - 1;
+        if (minX > maxX || minY > maxY) return;
+
+        for (int ty = minY / tileSize; ty <= maxY / tileSize; ty++) {
+            for (int tx = minX / tileSize; tx <= maxX / tileSize; tx++) {
+                Tile& tile = tiles[ty * tilesX + tx];
+                if (zTri >= tile.zMax0) continue;
+
+                // Coverage of the tile's pixels
+                uint64_t coverage = 0;
+                for (int py = 0; py < tileSize; py++) {
+                    float fy = (float)(ty * tileSize + py);
+                    for (int px = 0; px < tileSize; px++) {
+                        float fx = (float)(tx * tileSize + px);
+                        if (edgeA[0] * fx + edgeB[0] * fy + edgeC[0] >= 0.f &&
+                            edgeA[1] * fx + edgeB[1] * fy + edgeC[1] >= 0.f &&
+                            edgeA[2] * fx + edgeB[2] * fy + edgeC[2] >= 0.f)
+                            coverage |= 1ull << (py * tileSize + px);
+                    }
+                }
+                coverage &= ~tile.outside;
+                if (!coverage) continue;
+
+                // A triangle far in front of the working layer starts a new one rather than
+                // being merged into it and losing its depth
+                if (tile.zMax1 - zTri > tile.zMax0 - tile.zMax1) {
+                    tile.mask = 0;
+                    tile.zMax1 = 0.f;
+                }
+                tile.zMax1 = max(tile.zMax1, zTri);
+                tile.mask |= coverage;
+
+                // A full working layer replaces the tile's depth
+                if ((tile.mask | tile.outside) == ~0ull) {
+                    tile.zMax0 = min(tile.zMax0, tile.zMax1);
+                    tile.mask = 0;
+                    tile.zMax1 = 0.f;
+                }
+            }
+        }
+    }
+
+    // Tests a screen rectangle at a given depth
+    // Input Variables:
+    // - minX, minY, maxX, maxY: Screen-space rectangle in pixels
+    // - depth: Nearest depth of whatever the rectangle bounds
+    // Returns true if everything in the rectangle is behind the occluders
+    bool isOccluded(float minX, float minY, float maxX, float maxY, float depth) const {
+        int x0 = max((int)floor(minX / scale), 0);
+        int y0 = max((int)floor(minY / scale), 0);
+        int x1 = min((int)floor(maxX / scale), width - 1);
+        int y1 = min((int)floor(maxY / scale), height - 1);
+        if (x0 > x1 || y0 > y1) return false;
+
+        for (int ty = y0 / tileSize; ty <= y1 / tileSize; ty++) {
+            for (int tx = x0 / tileSize; tx <= x1 / tileSize; tx++) {
+                const Tile& tile = tiles[ty * tilesX + tx];
+
+                // Where the rectangle lies within the working layer its depth bounds it too
+                uint64_t rect = rectMask(max(x0 - tx * tileSize, 0), max(y0 - ty * tileSize, 0),
+                    min(x1 - tx * tileSize, tileSize - 1), min(y1 - ty * tileSize, tileSize - 1));
+                float farthest = (rect & ~tile.mask) ? tile.zMax0 : min(tile.zMax0, tile.zMax1);
+                if (depth < farthest) return false;
+            }
+        }
+        return true;
+    }
+
+    // Tests a bounding sphere
+    // Input Variables:
+    // - center: Sphere center in view space
+    // - radius: Sphere radius
+    // - perspective: Projection of the renderer
+    // Returns true if the sphere is entirely behind the occluders
+    bool isSphereOccluded(const vec4& center, float radius, const matrix& perspective) const {
+        // The camera looks down -z, spheres reaching the near plane are never culled
+        float nearest = -center[2] - radius;
+        vec4 clip = perspective * vec4(0.f, 0.f, -nearest, 1.f);
+        if (clip[3] <= 0.f || clip[2] < 0.f) return false;
+        float depth = clip[2] / clip[3];
+
+        // Screen bounds of the view-space box around the sphere
+        float minX = screenWidth, minY = screenHeight, maxX = 0.f, maxY = 0.f;
+        for (int corner = 0; corner < 8; corner++) {
+            vec4 p(center[0] + ((corner & 1) ? radius : -radius),
+                center[1] + ((corner & 2) ? radius : -radius),
+                center[2] + ((corner & 4) ? radius : -radius), 1.f);
+            vec4 c = perspective * p;
+            float sx = (c[0] / c[3] + 1.f) * 0.5f * screenWidth;
+            float sy = screenHeight - (c[1] / c[3] + 1.f) * 0.5f * screenHeight;
+            minX = min(minX, sx);
+            maxX = max(maxX, sx);
+            minY = min(minY, sy);
+            maxY = max(maxY, sy);
+        }
+        return isOccluded(minX, minY, maxX, maxY, depth);
+    }
+};
@@ -0,0 +1,636 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <deque>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+#include "matrix.h"
+#include "mesh.h"
+#include "renderer.h"
+#include "light.h"
+#include "triangle.h"
+#include "tileBins.h"
+#include "threadPool.h"
+#include "clipper.h"
+#include "frustum.h"
+#include "instancing.h"
+#include "bvh.h"
+#include "vertexTransform.h"
+#include "profiler.h"
+#include "stats.h"
+#include "radixSort.h"
+#include "occlusion.h"
+#include "frameArena.h"
+
+// Rendering pipeline shared by the interactive scenes and the benchmark: single-mesh reference
+// renderers plus the multithreaded transform / bin / raster path.
+
+// Transforms every vertex of a mesh once into screen space.
+// Triangles then index into the result, so shared vertices are not transformed again.
+// Input Variables:
+// - renderer: The Renderer object providing the canvas size.
+// - mesh: Pointer to the Mesh whose vertices are transformed, its streams must be up to date.
+// - world: World transformation of the mesh or instance being drawn.
+// - p: Combined perspective, camera and world transformation.
+// Output Variables:
+// - transformed: Post-transform vertex streams, one entry per mesh vertex.
+inline void transformVertices(Renderer& renderer, const Mesh* mesh, const matrix& world, const matrix& p, TransformedVertices& transformed) {
+    float width = static_cast<float>(renderer.canvas.getWidth());
+    float height = static_cast<float>(renderer.canvas.getHeight());
+    VertexTransform::transform(mesh->streams, p, world, width, height, transformed);
+}
+
+// Outcome of assembling a mesh triangle
+enum class Assembly { Culled, Inside, Clipped };
+
+// Turns one mesh triangle into screen-space triangles.
+// Triangles inside the view volume (and guard band) are gathered straight from the transformed streams,
+// those crossing the near or far plane (or leaving the guard band) are clipped in clip space first,
+// and those entirely outside one plane are dropped.
+// Input Variables:
+// - mesh: Mesh the triangle belongs to.
+// - ind: Vertex indices of the triangle.
+// - transformed: Post-transform vertices of the mesh.
+// - p: Combined perspective, camera and world transformation, used to rebuild clip-space positions.
+// - width, height: Screen dimensions in pixels.
+// - emit: Called with the three vertices of every resulting triangle.
+// Returns what happened to the triangle
+template <typename Emit>
+inline Assembly assembleTriangle(const Mesh* mesh, const triIndices& ind, const TransformedVertices& transformed, const matrix& p, float width, float height, Emit&& emit) {
+    unsigned int c0 = transformed.outcode[ind.v[0]];
+    unsigned int c1 = transformed.outcode[ind.v[1]];
+    unsigned int c2 = transformed.outcode[ind.v[2]];
+
+    if (c0 & c1 & c2) return Assembly::Culled; // All vertices outside the same plane
+
+    Vertex v[3];
+    if (!(c0 | c1 | c2)) {
+        for (int k = 0; k < 3; k++)
+            transformed.get(ind.v[k], mesh->streams, v[k]);
+        emit(v[0], v[1], v[2]);
+        return Assembly::Inside;
+    }
+
+    // Clip in homogeneous space, where the positions are still linear. The vertices are read
+    // from the same streams as above, so clipped and unclipped triangles always agree.
+    const VertexStreams& in = mesh->streams;
+    for (int k = 0; k < 3; k++) {
+        unsigned int i = ind.v[k];
+        v[k].p = p * vec4(in.px[i], in.py[i], in.pz[i], 1.f);
+        v[k].normal = vec4(transformed.nx[i], transformed.ny[i], transformed.nz[i], 0.f);
+        v[k].rgb = colour(in.r[i], in.g[i], in.b[i]);
+    }
+
+    Vertex polygon[Clipper::maxVertices];
+    int count = Clipper::clip(v, c0 | c1 | c2, polygon);
+    for (int k = 0; k < count; k++)
+        Clipper::toScreen(polygon[k], width, height);
+
+    // The clipped polygon is convex, draw it as a fan
+    for (int k = 1; k + 1 < count; k++)
+        emit(polygon[0], polygon[k], polygon[k + 1]);
+    return Assembly::Clipped;
+}
+
+// Main rendering function that processes a mesh, transforms its vertices, applies lighting, and draws triangles on the canvas.
+// Input Variables:
+// - renderer: The Renderer object used for drawing.
+// - mesh: Pointer to the Mesh object containing vertices and triangles to render.
+// - camera: Matrix representing the camera's transformation.
+// - L: Light object representing the lighting parameters.
+inline void render(Renderer& renderer, Mesh* mesh, matrix& camera, Light& L) {
+    PROFILE_SCOPE("render");
+    // Combine perspective, camera, and world transformations for the mesh
+    matrix p = renderer.perspective * camera * mesh->world;
+
+    // Transform each vertex of the mesh once
+    TransformedVertices transformed;
+    mesh->refreshStreams();
+    transformVertices(renderer, mesh, mesh->world, p, transformed);
+    float width = static_cast<float>(renderer.canvas.getWidth());
+    float height = static_cast<float>(renderer.canvas.getHeight());
+
+    // Iterate through all triangles in the mesh, clipping them against the view volume
+    for (triIndices& ind : mesh->triangles) {
+        assembleTriangle(mesh, ind, transformed, p, width, height, [&](const Vertex& t0, const Vertex& t1, const Vertex& t2) {
+            // Set up the triangle and render it
+            TriSetup setup(t0, t1, t2);
+            TriAttributes attributes(t0, t1, t2, mesh->ka, mesh->kd);
+            triangle(setup, attributes).draw(renderer, L, mesh->kd);
+        });
+    }
+}
+
+inline void cullingRender(Renderer& renderer, Mesh* mesh, matrix& camera, Light& L)
+{
+    PROFILE_SCOPE("cullingRender");
+    // Skip the mesh if its bounding sphere is outside any of the six frustum planes
+    vec4 center;
+    float radius;
+    mesh->getWorldBounds(center, radius);
+    if (Frustum::fromMatrix(renderer.perspective * camera).testSphere(center, radius) == Visibility::Outside) {
+        return;
+    }
+
+    matrix cw = camera * mesh->world;             // transform to camera space
+    matrix p = renderer.perspective * cw;        // then to clip space 
+
+    // Transform each vertex once, to camera space for the facing test and to screen space for drawing
+    mesh->refreshStreams();
+    const VertexStreams& streams = mesh->streams;
+    std::vector<vec4> cameraSpace(streams.size());
+    for (size_t i = 0; i < streams.size(); i++)
+        cameraSpace[i] = cw * vec4(streams.px[i], streams.py[i], streams.pz[i], 1.f);
+
+    TransformedVertices transformed;
+    transformVertices(renderer, mesh, mesh->world, p, transformed);
+    float width = static_cast<float>(renderer.canvas.getWidth());
+    float height = static_cast<float>(renderer.canvas.getHeight());
+
+    for (triIndices& ind : mesh->triangles)
+    {
+        // Camera-space positions of the triangle's vertices
+        const vec4& c0 = cameraSpace[ind.v[0]];
+        const vec4& c1 = cameraSpace[ind.v[1]];
+        const vec4& c2 = cameraSpace[ind.v[2]];
+
+        // Convert them to vec3 for cross product
+        vec3 v0(c0[0], c0[1], c0[2]);
+        vec3 v1(c1[0], c1[1], c1[2]);
+        vec3 v2(c2[0], c2[1], c2[2]);
+
+        // Edges in camera space
+        vec3 e1 = v1 - v0;
+        vec3 e2 = v2 - v0;
+
+        // Cross product
+        vec3 cross = e1.cross(e2);
+        // cross.z > 0 => back-facing.  If your model disappears, flip the sign check.
+        if (cross.z > 0.0f)
+        {
+            continue; // Skip back-facing triangles
+        }
+
+        // clip against the near/far planes, then draw the triangles
+        assembleTriangle(mesh, ind, transformed, p, width, height, [&](const Vertex& t0, const Vertex& t1, const Vertex& t2) {
+            TriSetup setup(t0, t1, t2);
+            TriAttributes attributes(t0, t1, t2, mesh->ka, mesh->kd);
+            triangle(setup, attributes).draw(renderer, L, mesh->kd);
+        });
+    }
+}
+
+
+inline SceneBVH sceneBVH;                   // Hierarchy over the draw items of the scene, refitted every frame
+inline std::vector<DrawItem> drawItems;     // Meshes and instances of the scene this frame
+inline std::vector<DrawItem> visibleItems;  // Draw items that survive frustum culling this frame
+inline std::vector<unsigned int> visibleIndices;
+inline TileBins tileBins;                   // Screen tiles shared by the binning and raster phases
+inline std::deque<Task> transformTasks;     // Per-chunk tasks, kept between frames so they are not reallocated
+inline std::deque<Task> binningTasks;
+inline RenderStats frameStats;              // Statistics of the last renderSceneMT call
+inline std::vector<unsigned long long> itemOrder, itemOrderScratch; // Sort entries of visibleItems
+inline std::vector<DrawItem> sortedItems;
+inline std::vector<vec4> itemCenters;       // Camera-space bounding sphere centres of the items being sorted
+inline OcclusionBuffer occlusionBuffer;     // Occluders of the current frame, see occlusionCull
+
+// Screen-space triangles produced by one chunk of the scene, in two parallel arrays: binning and
+// the raster loops stream the compact setups, shading reads the attributes at the same index.
+// Both live in the frame arena of the thread that transformed the chunk.
+struct TriangleList {
+    ArenaArray<TriSetup> setups;
+    ArenaArray<TriAttributes> attributes;
+
+    size_t size() const { return setups.size(); }
+
+    // Drops the triangles of the last frame, call before the chunk is transformed again
+    void reset() {
+        setups.reset();
+        attributes.reset();
+    }
+
+    // Returns triangle index, set up for drawing
+    triangle get(size_t index) const { return triangle(setups[index], attributes[index]); }
+};
+
+inline std::vector<TriangleList> chunkTriangles;         // Triangles of every chunk this frame, see drawVisibleItems
+inline std::vector<TransformedVertices> workerVertices;  // Post-transform vertices, one set per pool thread reused for every mesh it transforms
+
+
+// Transforms and clips the triangles of a range of draw items into the triangle list of a chunk
+// Input Variables:
+// - renderer: The Renderer object providing the projection and canvas size
+// - scene: Draw items of the frame
+// - camera: Matrix representing the camera's transformation
+// - start, end: Range of draw items belonging to the chunk
+// - threadTriangles: Triangle lists of every chunk
+// - threadIndex: Index of the chunk, selects the list the triangles are added to
+inline void clipping(Renderer& renderer, std::vector<DrawItem>& scene, matrix& camera, size_t start, size_t end, std::vector<TriangleList>& threadTriangles, size_t threadIndex) {
+    PROFILE_SCOPE("transform");
+    TransformedVertices& transformed = workerVertices[ThreadPool::workerIndex()];
+    float width = static_cast<float>(renderer.canvas.getWidth());
+    float height = static_cast<float>(renderer.canvas.getHeight());
+    TriangleList& triangles = threadTriangles[threadIndex];
+    RenderStats& stats = localStats();
+
+    // Room for one setup per triangle of the chunk, so the lists only grow when clipping splits triangles
+    size_t maxTriangles = 0;
+    for (size_t i = start; i < end; i++)
+        maxTriangles += scene[i].geometry->triangles.size();
+    triangles.setups.reserve(maxTriangles);
+    triangles.attributes.reserve(maxTriangles);
+
+    for (size_t i = start; i < end; i++) {
+        const DrawItem& item = scene[i];
+        const Mesh* mesh = item.geometry;
+        matrix p = renderer.perspective * camera * *item.world;
+        transformVertices(renderer, mesh, *item.world, p, transformed);
+
+        // Outcodes are checked on the streams first, only surviving triangles are gathered into vertices
+        for (size_t t = 0; t < mesh->triangles.size(); t++) {
+            Assembly result = assembleTriangle(mesh, mesh->triangles[t], transformed, p, width, height, [&](const Vertex& v0, const Vertex& v1, const Vertex& v2) {
+                const TriSetup& setup = triangles.setups.emplace_back(v0, v1, v2);
+
+                // Triangles the raster phase would skip are dropped here, before they are binned:
+                // back-facing ones, and those too small to contain any pixel centre. Only the
+                // triangles kept get their attributes.
+                int sx0, sy0, sx1, sy1;
+                setup.getSampleBounds(sx0, sy0, sx1, sy1);
+                if (setup.area < 0.f) {
+                    stats.trianglesBackFacing++;
+                    triangles.setups.pop_back();
+                } else if (setup.area == 0.f || sx0 >= sx1 || sy0 >= sy1) {
+                    stats.trianglesTooSmall++;
+                    triangles.setups.pop_back();
+                } else {
+                    triangles.attributes.emplace_back(v0, v1, v2, item.ka, item.kd);
+                }
+            });
+            if (result == Assembly::Culled) stats.trianglesFrustumCulled++;
+            else if (result == Assembly::Clipped) stats.trianglesClipped++;
+        }
+    }
+    stats.triangles += triangles.size();
+}
+
+// Sorts the triangles produced by one chunk of the scene into the screen tiles they overlap
+// Input Variables:
+// - triangles: Triangles produced by the chunk
+// - chunkIndex: Index of the chunk, selects its private set of bins
+// - frontToBack: Key every triangle by its nearest depth, for rasterTile to sort on
+inline void binning(const TriangleList& triangles, size_t chunkIndex, bool frontToBack) {
+    PROFILE_SCOPE("binning");
+    tileBins.clear(chunkIndex);
+
+    // Count the triangles of every bin first, so each bin is allocated once in the frame arena
+    for (const TriSetup& setup : triangles.setups) {
+        int x0, y0, x1, y1;
+        setup.getSampleBounds(x0, y0, x1, y1);
+        tileBins.reserve(chunkIndex, x0, y0, x1, y1);
+    }
+    tileBins.allocate(chunkIndex);
+
+    for (size_t t = 0; t < triangles.size(); t++) {
+        const TriSetup& setup = triangles.setups[t];
+        int x0, y0, x1, y1;
+        setup.getSampleBounds(x0, y0, x1, y1);
+        unsigned int key = frontToBack ? screenDepthKey(setup.getMinDepth()) : 0;
+        tileBins.add(chunkIndex, makeSortEntry(key, (unsigned int)t), x0, y0, x1, y1);
+    }
+}
+
+// Culls draw items hidden behind occluders before they are transformed. The occluders among
+// the items are rasterized into the low-resolution occlusion buffer, then every other item's
+// bounding sphere is tested against it and dropped if it is hidden.
+// Input Variables:
+// - renderer: The Renderer object providing the projection and canvas size
+// - camera: Matrix representing the camera's transformation
+// - items: Draw items that survived frustum culling
+// Output Variables:
+// - items: The occluders and the items not hidden behind them, in their original order
+// Returns the number of triangles of the items removed
+inline size_t occlusionCull(Renderer& renderer, matrix& camera, std::vector<DrawItem>& items) {
+    bool anyOccluder = false;
+    for (const DrawItem& item : items)
+        anyOccluder |= item.occluder;
+    if (!anyOccluder) return 0;
+
+    PROFILE_SCOPE("occlusion");
+    float width = static_cast<float>(renderer.canvas.getWidth());
+    float height = static_cast<float>(renderer.canvas.getHeight());
+    occlusionBuffer.resize(renderer.canvas.getWidth(), renderer.canvas.getHeight());
+    occlusionBuffer.clear();
+
+    TransformedVertices& transformed = workerVertices[ThreadPool::workerIndex()];
+    for (const DrawItem& item : items) {
+        if (!item.occluder) continue;
+        matrix p = renderer.perspective * camera * *item.world;
+        transformVertices(renderer, item.geometry, *item.world, p, transformed);
+        for (const triIndices& ind : item.geometry->triangles) {
+            assembleTriangle(item.geometry, ind, transformed, p, width, height, [&](const Vertex& v0, const Vertex& v1, const Vertex& v2) {
+                occlusionBuffer.drawTriangle(v0.p, v1.p, v2.p);
+            });
+        }
+    }
+
+    size_t kept = 0, trianglesOccluded = 0;
+    for (const DrawItem& item : items) {
+        if (!item.occluder) {
+            vec4 center;
+            float radius;
+            item.geometry->getWorldBounds(*item.world, center, radius);
+            if (occlusionBuffer.isSphereOccluded(camera * center, radius, renderer.perspective)) {
+                trianglesOccluded += item.geometry->triangles.size();
+                continue;
+            }
+        }
+        items[kept++] = item;
+    }
+    items.resize(kept);
+    return trianglesOccluded;
+}
+
+// Orders draw items front to back by the depth of their bounding sphere centres, so items
+// near each other in depth share chunks and triangles with equal sort keys in a tile are
+// drawn nearest item first (see rasterTile). The centre rather than the nearest point of the
+// sphere keeps large items from sorting ahead of smaller ones that are nearer.
+// This gives up keeping instances of the same geometry next to each other.
+// Input Variables:
+// - items: Draw items to reorder
+// - camera: Matrix representing the camera's transformation
+inline void sortFrontToBack(std::vector<DrawItem>& items, const matrix& camera) {
+    PROFILE_SCOPE("sort items");
+    itemCenters.resize(items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        float radius;
+        items[i].geometry->getWorldBounds(*items[i].world, itemCenters[i], radius);
+    }
+    camera.transformPoints(itemCenters.data(), itemCenters.data(), items.size());
+
+    itemOrder.clear();
+    for (size_t i = 0; i < items.size(); i++) {
+        // The camera looks down -z
+        float distance = -itemCenters[i][2];
+        itemOrder.push_back(makeSortEntry(viewDepthKey(distance), (unsigned int)i));
+    }
+    radixSort(itemOrder, itemOrderScratch);
+
+    sortedItems.clear();
+    for (unsigned long long entry : itemOrder)
+        sortedItems.push_back(items[sortEntryValue(entry)]);
+    items.swap(sortedItems);
+}
+
+// Shades the visibility buffer of one screen tile, once per pixel that holds a triangle
+// Input Variables:
+// - renderer: The Renderer object used for drawing
+// - L: Light used for shading (a per-thread copy, already normalised)
+// - chunkTriangles: Triangles produced by every chunk of the scene
+// - indexBits: Low bits of an ID holding the triangle's index in its chunk, the rest hold the
+//   chunk. Below 32, drawVisibleItems checks that the chunk and index fit in 32 bits.
+// - x0, y0, x1, y1: Pixel rectangle of the tile
+inline void resolveTile(Renderer& renderer, Light& L, const std::vector<TriangleList>& chunkTriangles, unsigned int indexBits, int x0, int y0, int x1, int y1) {
+    PROFILE_SCOPE("resolve tile");
+    unsigned int indexMask = (1u << indexBits) - 1;
+    size_t resolved = 0;
+
+    // Runs of the same triangle often follow each other down the rows, its setup is kept for them
+    std::optional<triangle> tri;
+    unsigned int triId = 0;
+    for (int y = y0; y < y1; y++) {
+        const unsigned int* ids = &renderer.visibility[y * renderer.canvas.getWidth()];
+        int x = x0;
+        while (x < x1) {
+            if (renderer.zbuffer.depth(x, y) >= 1.0f) {
+                x++;
+                continue;
+            }
+
+            // Neighbouring pixels of the same triangle are shaded together
+            unsigned int id = ids[x];
+            int end = x + 1;
+            while (end < x1 && ids[end] == id && renderer.zbuffer.depth(end, y) < 1.0f)
+                end++;
+            if (!tri || id != triId) {
+                tri.emplace(chunkTriangles[id >> indexBits].get(id & indexMask));
+                triId = id;
+            }
+            tri->resolveRun(renderer, L, x, y, end - x);
+            resolved += end - x;
+            x = end;
+        }
+    }
+    localStats().pixelsResolved += resolved;
+}
+
+// Rasterizes one screen tile
+// Each tile is drawn by exactly one thread, so canvas and Z-buffer writes need no locking
+// In visibility-buffer mode the triangles only store depth and IDs, and the tile is shaded
+// by resolveTile once all of them are in.
+// Input Variables:
+// - renderer: The Renderer object used for drawing
+// - L: Light used for shading (a per-thread copy)
+// - chunkTriangles: Triangles produced by every chunk of the scene, each with its own material
+// - indexBits: Split of the visibility-buffer IDs, see resolveTile
+// - tile: Index of the tile to draw
+inline void rasterTile(Renderer& renderer, Light& L, const std::vector<TriangleList>& chunkTriangles, unsigned int indexBits, int tile) {
+    PROFILE_SCOPE("raster tile");
+    size_t pixels = 0;
+    int x0, y0, x1, y1;
+    tileBins.getTileRect(tile, x0, y0, x1, y1);
+
+    // The tile's triangles from every chunk, as sort entries holding visibility-buffer IDs.
+    // Concatenating the bins in chunk order gives submission order. Front to back, the whole
+    // list is sorted by the keys binning gave the triangles: sorting each chunk's bin alone
+    // would still replay the chunks one after another, each starting again from its nearest
+    // triangle.
+    const unsigned int indexMask = (1u << indexBits) - 1;
+    size_t count = 0;
+    for (size_t i = 0; i < chunkTriangles.size(); i++)
+        count += tileBins.bins[i][tile].size();
+    ArenaArray<unsigned long long> order, scratch;
+    order.resize(count);
+    count = 0;
+    for (size_t i = 0; i < chunkTriangles.size(); i++) {
+        unsigned long long chunk = (unsigned long long)i << indexBits;
+        for (unsigned long long entry : tileBins.bins[i][tile])
+            order[count++] = entry | chunk;
+    }
+    if (renderer.frontToBack)
+        radixSort(order, scratch);
+
+    // Depth prepass: the final depth of every pixel is known before anything is shaded
+    bool prepass = renderer.depthPrepass && !renderer.visibilityBuffer;
+    if (prepass) {
+        PROFILE_SCOPE("depth prepass");
+        for (unsigned long long entry : order) {
+            unsigned int id = sortEntryValue(entry);
+            chunkTriangles[id >> indexBits].get(id & indexMask).drawDepth(renderer, x0, y0, x1, y1);
+        }
+    }
+
+    for (unsigned long long entry : order) {
+        unsigned int id = sortEntryValue(entry);
+        const TriangleList& triangles = chunkTriangles[id >> indexBits];
+        triangle tri = triangles.get(id & indexMask);
+        if (renderer.visibilityBuffer) {
+            pixels += tri.drawVisibility(renderer, id, x0, y0, x1, y1);
+        } else {
+            const TriAttributes& material = triangles.attributes[id & indexMask];
+            pixels += tri.draw(renderer, L, material.kd, x0, y0, x1, y1, prepass);
+        }
+    }
+
+    if (renderer.visibilityBuffer) {
+        L.omega_i.normalise();
+        resolveTile(renderer, L, chunkTriangles, indexBits, x0, y0, x1, y1);
+    }
+
+    // Every pixel written at least once now holds a depth below the cleared 1.0,
+    // any other write to the tile was overwritten
+    if (renderer.measureOverdraw) {
+        size_t covered = 0;
+        for (int y = y0; y < y1; y++)
+            for (int x = x0; x < x1; x++)
+                covered += renderer.zbuffer.depth(x, y) < 1.0f;
+        localStats().pixelsOverwritten += pixels - covered;
+    }
+
+    // Debug view: replace the shaded colours with how often each pixel was shaded
+    if (renderer.overdrawHeatmap) {
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                unsigned char r, g, b;
+                heatColour(renderer.overdraw[y * renderer.canvas.getWidth() + x], r, g, b);
+                renderer.canvas.draw(x, y, r, g, b);
+            }
+        }
+    }
+}
+
+// Transforms, bins and rasterizes visibleItems on the thread pool
+// Input Variables:
+// - renderer: The Renderer object used for drawing
+// - camera: Matrix representing the camera's transformation
+// - L: Light object representing the lighting parameters
+inline void drawVisibleItems(Renderer& renderer, matrix& camera, Light& L) {
+    ThreadPool& pool = ThreadPool::getInstance();
+    size_t numMeshes = visibleItems.size();
+
+    // Several chunks per thread so that work stealing can even out meshes of different sizes
+    size_t numChunks = min(numMeshes, (size_t)pool.threadCount() * 4);
+    size_t chunkSize = (numMeshes + numChunks - 1) / numChunks;
+    numChunks = (numMeshes + chunkSize - 1) / chunkSize;
+
+    chunkTriangles.resize(numChunks);
+    for (TriangleList& triangles : chunkTriangles)
+        triangles.reset();
+    tileBins.resize(renderer.canvas.getWidth(), renderer.canvas.getHeight(), numChunks);
+    while (transformTasks.size() < numChunks) {
+        transformTasks.emplace_back();
+        binningTasks.emplace_back();
+    }
+
+    // Transform and bin: every chunk of meshes is transformed, then binned once its transform is done.
+    // The tasks capture only frame and their chunk index, small enough for std::function to store
+    // without allocating.
+    struct {
+        Renderer& renderer;
+        matrix& camera;
+        Light& L;
+        size_t chunkSize, numMeshes;
+    } frame{ renderer, camera, L, chunkSize, numMeshes };
+
+    JobCounter counter;
+    for (size_t i = 0; i < numChunks; i++) {
+        transformTasks[i].reset([&frame, i]() {
+            size_t start = i * frame.chunkSize;
+            size_t end = min(start + frame.chunkSize, frame.numMeshes);
+            clipping(frame.renderer, visibleItems, frame.camera, start, end, chunkTriangles, i);
+        });
+        binningTasks[i].reset([&frame, i]() { binning(chunkTriangles[i], i, frame.renderer.frontToBack); });
+        transformTasks[i].precede(binningTasks[i]);
+
+        pool.run(binningTasks[i], counter);
+        pool.run(transformTasks[i], counter);
+    }
+    pool.wait(counter);
+
+    // Visibility-buffer IDs pack the chunk above the triangle's index in the chunk, and must fit
+    // in the 32-bit value of a sort entry. Counting at least one chunk bit keeps indexBits below
+    // 32, so the shifts and masks built from it stay defined.
+    size_t largestChunk = 0;
+    for (const TriangleList& triangles : chunkTriangles)
+        largestChunk = max(largestChunk, triangles.size());
+    unsigned int indexBits = (unsigned int)std::bit_width(largestChunk);
+    unsigned int chunkBits = max(1u, (unsigned int)std::bit_width(numChunks - 1));
+    if (chunkBits + indexBits > 32)
+        throw std::length_error("Too many triangles in a chunk for 32-bit visibility-buffer IDs");
+
+    // Raster: tiles are handed out to the pool, each thread shading with its own copy of the light
+    pool.parallelFor(0, tileBins.count(), 1, [&](size_t first, size_t last) {
+        Light localL = L;
+        for (size_t tile = first; tile < last; tile++)
+            rasterTile(renderer, localL, chunkTriangles, indexBits, (int)tile);
+    });
+}
+
+// Renders a scene of individual meshes and instanced meshes with the multithreaded tile pipeline.
+// Every mesh and every instance becomes a draw item. With frontToBack off, instances of the same
+// geometry stay next to each other so they are transformed and binned together; with it on (the
+// default) the items are reordered by depth and instances end up wherever their depth puts them.
+// What the frame did is left in frameStats.
+// Input Variables:
+// - renderer: The Renderer object used for drawing
+// - scene: Individually allocated meshes
+// - instanced: Instanced meshes, each drawing its shared geometry once per instance
+// - camera: Matrix representing the camera's transformation
+// - L: Light object representing the lighting parameters
+inline void renderSceneMT(Renderer& renderer, std::vector<Mesh*>& scene, std::vector<InstancedMesh*>& instanced, matrix& camera, Light& L) {
+    PROFILE_SCOPE("renderSceneMT");
+    FrameArenas::getInstance().beginFrame();
+    workerVertices.resize(ThreadPool::getInstance().threadCount());
+    resetStats();
+    RenderStats& stats = localStats();
+
+    DrawItem::gather(scene, instanced, drawItems);
+    stats.drawItems = drawItems.size();
+    for (const DrawItem& item : drawItems)
+        stats.trianglesSubmitted += item.geometry->triangles.size();
+
+    if (!drawItems.empty()) {
+        // Frustum cull the scene hierarchically, only visible items go through the pipeline
+        {
+            PROFILE_SCOPE("cull");
+            sceneBVH.update(drawItems);
+            sceneBVH.cull(Frustum::fromMatrix(renderer.perspective * camera), visibleIndices);
+        }
+        visibleItems.clear();
+        size_t visibleTriangles = 0;
+        for (unsigned int i : visibleIndices) {
+            visibleItems.push_back(drawItems[i]);
+            visibleTriangles += drawItems[i].geometry->triangles.size();
+        }
+        stats.visibleItems = visibleItems.size();
+        stats.trianglesFrustumCulled += stats.trianglesSubmitted - visibleTriangles;
+        if (renderer.occlusionCulling) {
+            stats.trianglesOccluded = occlusionCull(renderer, camera, visibleItems);
+            stats.itemsOccluded = stats.visibleItems - visibleItems.size();
+        }
+        if (renderer.frontToBack)
+            sortFrontToBack(visibleItems, camera);
+
+        if (!visibleItems.empty())
+            drawVisibleItems(renderer, camera, L);
+    }
+
+    frameStats = gatherStats();
+}
+
+// Renders a scene of individual meshes with the multithreaded tile pipeline
+inline void renderSceneMT(Renderer& renderer, std::vector<Mesh*>& scene, matrix& camera, Light& L) {
+    std::vector<InstancedMesh*> instanced;
+    renderSceneMT(renderer, scene, instanced, camera, L);
+}
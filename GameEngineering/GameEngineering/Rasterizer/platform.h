@@ -0,0 +1,24 @@
+#pragma once
+
+// Platform layer. On Windows the GamesEngineeringBase framework (Win32 + D3D11) provides the
+// window, and Windows.h provides the min and max macros used throughout the rasterizer.
+// Elsewhere there is no window, only offscreen render targets, and the pieces of Windows.h
+// the rasterizer relies on are supplied here.
+#if defined(_WIN32)
+
+#include "GamesEngineeringBase.h"
+
+#else
+
+#include <type_traits>
+
+// Same semantics as the Windows.h macros, including arguments of different types
+template <typename A, typename B>
+constexpr std::common_type_t<A, B> min(A a, B b) { return (a < b) ? a : b; }
+
+template <typename A, typename B>
+constexpr std::common_type_t<A, B> max(A a, B b) { return (a > b) ? a : b; }
+
+#define VK_ESCAPE 0x1B
+
+#endif
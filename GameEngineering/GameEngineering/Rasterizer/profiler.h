@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Profiling can be compiled out entirely by defining PROFILER_ENABLED as 0, which turns every
+// PROFILE_SCOPE into nothing. When compiled in it is still off until Profiler::setEnabled(true),
+// and a disabled scope costs one relaxed load and a branch.
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+// Records timed scopes per thread and exports them as a Chrome trace (chrome://tracing, Perfetto).
+// Every thread writes to its own ring buffer, so recording takes no locks and never allocates;
+// when a buffer is full the oldest events are overwritten, keeping the most recent frames.
+class Profiler {
+public:
+    static const size_t capacity = 1 << 16; // Events kept per thread
+
+    // One finished scope
+    struct Event {
+        const char* name;   // Scope name, must be a string literal
+        long long start;    // Nanoseconds since the profiler was created
+        long long end;
+    };
+
+private:
+    // Events of one thread. Only the owning thread writes, exports read once it is idle.
+    struct ThreadBuffer {
+        std::vector<Event> events = std::vector<Event>(capacity);
+        std::atomic<size_t> written = 0;  // Events recorded so far, the next one goes to written % capacity
+        unsigned int id = 0;              // Thread id in the trace
+        std::string name;                 // Thread name in the trace
+    };
+
+    std::atomic<bool> enabled = false;
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::mutex lock;                                   // Guards the list of buffers
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers; // Owned here so they outlive their threads
+
+    Profiler() {}
+
+    // Buffer of the calling thread, registered on first use
+    ThreadBuffer& localBuffer() {
+        static thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer) {
+            std::lock_guard<std::mutex> guard(lock);
+            buffers.push_back(std::make_unique<ThreadBuffer>());
+            buffer = buffers.back().get();
+            buffer->id = static_cast<unsigned int>(buffers.size());
+            buffer->name = "thread " + std::to_string(buffer->id);
+        }
+        return *buffer;
+    }
+
+public:
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // Get the shared profiler, created on first use
+    static Profiler& getInstance() {
+        static Profiler instance;
+        return instance;
+    }
+
+    // Turns recording on or off at runtime
+    void setEnabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // Nanoseconds since the profiler was created
+    long long now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    // Names the calling thread in exported traces
+    // Input Variables:
+    // - name: Thread name, e.g. "worker 3"
+    void setThreadName(const std::string& name) {
+        ThreadBuffer& buffer = localBuffer();
+        std::lock_guard<std::mutex> guard(lock);
+        buffer.name = name;
+    }
+
+    // Records a finished scope on the calling thread
+    // Input Variables:
+    // - name: Scope name, must be a string literal
+    // - start, end: Times from now()
+    void record(const char* name, long long start, long long end) {
+        ThreadBuffer& buffer = localBuffer();
+        size_t index = buffer.written.load(std::memory_order_relaxed);
+        buffer.events[index % capacity] = { name, start, end };
+        buffer.written.store(index + 1, std::memory_order_release);
+    }
+
+    // Drops all recorded events
+    // Must not run while other threads are recording, e.g. call it between frames
+    void reset() {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto& buffer : buffers)
+            buffer->written.store(0, std::memory_order_relaxed);
+    }
+
+    // Writes every thread's timeline in the Chrome trace-event format, one complete ("X")
+    // event per scope and one metadata event naming each thread.
+    // Must not run while other threads are recording, e.g. call it between frames
+    // Input Variables:
+    // - filename: Path of the JSON file to write
+    // Returns true if the file was written
+    bool writeChromeTrace(const std::string& filename) {
+        std::ofstream file(filename);
+        if (!file) return false;
+
+        std::lock_guard<std::mutex> guard(lock);
+        file << "{\"traceEvents\":[\n";
+        bool first = true;
+        for (auto& buffer : buffers) {
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+                 << ",\"args\":{\"name\":\"" << buffer->name << "\"}}";
+            first = false;
+
+            size_t written = buffer->written.load(std::memory_order_acquire);
+            size_t begin = written > capacity ? written - capacity : 0;
+            for (size_t i = begin; i < written; i++) {
+                const Event& e = buffer->events[i % capacity];
+                // Timestamps are in microseconds, kept fractional so short scopes do not collapse to zero
+                file << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+                     << ",\"ts\":" << e.start / 1000 << "." << (e.start % 1000) / 100
+                     << ",\"dur\":" << (e.end - e.start) / 1000 << "." << ((e.end - e.start) % 1000) / 100 << "}";
+            }
+        }
+        file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return static_cast<bool>(file);
+    }
+};
+
+// Times the enclosing scope, use through PROFILE_SCOPE
+class ProfileScope {
+    const char* name;
+    long long start = -1; // -1 if the profiler was off when the scope began
+
+public:
+    ProfileScope(const char* _name) : name(_name) {
+        Profiler& profiler = Profiler::getInstance();
+        if (profiler.isEnabled()) start = profiler.now();
+    }
+
+    ~ProfileScope() {
+        if (start < 0) return;
+        Profiler& profiler = Profiler::getInstance();
+        profiler.record(name, start, profiler.now());
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// Records the time from this line to the end of the enclosing block under the given name
+#if PROFILER_ENABLED
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+// Stable sorting of indices by 16-bit keys, used to order draw items and tile bins front to back.
+// Each entry packs its key above a 32-bit value: (key << 32) | value.
+// Entries with equal keys keep their order, so ties are still drawn in submission order.
+
+// Small arrays are insertion sorted, below this size the radix passes cost more than they save
+const size_t radixSortThreshold = 64;
+
+// Quantizes a view-space distance into a 16-bit sort key.
+// The top bits of a positive float increase with its value, so keeping the exponent and the
+// upper 7 mantissa bits gives keys that are finer near the camera than far away.
+// Input Variables:
+// - distance: Distance in front of the camera, negative values are treated as 0
+// Returns the key
+inline unsigned int viewDepthKey(float distance) {
+    if (!(distance > 0.f)) return 0;
+    unsigned int bits;
+    memcpy(&bits, &distance, sizeof(bits));
+    return bits >> 16;
+}
+
+// Quantizes a screen-space depth (0 to 1, as stored in the Z-buffer) into a 16-bit sort key.
+// The projection already spends most of the range near the camera, so steps are uniform.
+// Input Variables:
+// - depth: Depth to quantize, clamped to 0 to 1
+// Returns the key
+inline unsigned int screenDepthKey(float depth) {
+    if (!(depth > 0.f)) return 0;
+    if (depth >= 1.f) return 0xFFFF;
+    return (unsigned int)(depth * 65535.f);
+}
+
+// Packs a key and a value into one sort entry
+inline unsigned long long makeSortEntry(unsigned int key, unsigned int value) {
+    return ((unsigned long long)key << 32) | value;
+}
+
+// Returns the value of a sort entry
+inline unsigned int sortEntryValue(unsigned long long entry) {
+    return (unsigned int)entry;
+}
+
+// Sorts entries by their key with two 8-bit least-significant-digit passes.
+// A pass is skipped when every entry has the same digit.
+// Input Variables:
+// - entries: Entries from makeSortEntry
+// - scratch: Temporary storage, kept by the caller so it is not reallocated every frame
+// Output Variables:
+// - entries: Sorted by key, entries with equal keys in their original order
+// Array is std::vector or ArenaArray of unsigned long long
+template <typename Array>
+inline void radixSort(Array& entries, Array& scratch) {
+    size_t n = entries.size();
+    if (n < radixSortThreshold) {
+        for (size_t i = 1; i < n; i++) {
+            unsigned long long entry = entries[i];
+            size_t j = i;
+            for (; j > 0 && (entries[j - 1] >> 32) > (entry >> 32); j--)
+                entries[j] = entries[j - 1];
+            entries[j] = entry;
+        }
+        return;
+    }
+
+    scratch.resize(n);
+    for (unsigned int shift = 32; shift < 48; shift += 8) {
+        size_t counts[256] = {};
+        for (unsigned long long entry : entries)
+            counts[(entry >> shift) & 0xFF]++;
+        if (counts[(entries[0] >> shift) & 0xFF] == n) continue;
+
+        // Turn the counts into the first output position of each digit
+        size_t offset = 0;
+        for (size_t& count : counts) {
+            size_t c = count;
+            count = offset;
+            offset += c;
+        }
+        for (unsigned long long entry : entries)
+            scratch[counts[(entry >> shift) & 0xFF]++] = entry;
+        entries.swap(scratch);
+    }
+}
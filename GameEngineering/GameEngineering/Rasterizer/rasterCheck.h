@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "platform.h"
+#include "renderer.h"
+#include "triangle.h"
+#include "tileBins.h"
+#include "light.h"
+#include "RNG.h"
+#include "simd.h"
+
+// Headless check of the rasterizer's coverage rules. Each check mesh is a set of screen-space
+// triangles that share edges and vertices and together cover exactly a rectangle whose edges lie
+// on pixel centres. By the top-left rule the rectangle's left column and top row of centres are
+// covered and its right column and bottom row are not, so every pixel of [x0, x1) x [y0, y1)
+// must be shaded exactly once and every other pixel never. Pixels shaded twice mean an edge
+// shared by two triangles was counted for both, unshaded pixels inside mean it was counted for
+// neither.
+//
+// Every mesh is drawn with each SIMD level the CPU supports, through the forward and the
+// visibility-buffer kernels, and both whole and one 64x64 tile at a time as the tiled renderer
+// does. Triangles are drawn each a little nearer than the last so the depth test never hides a
+// pixel that is drawn twice.
+
+// Screen-space triangles of a check and the pixels they must cover
+struct CoverageMesh {
+    std::string name;
+    std::vector<vec4> points;          // Vertex positions in pixels, only x and y are used
+    std::vector<triIndices> triangles; // Wound so that their TriSetup area is positive
+    int x0, y0, x1, y1;                // Pixels covered once, the edges run through the centres of x0, y0, x1 and y1
+};
+
+// Two triangles splitting a square along its diagonal, which passes through a pixel centre on
+// every row
+inline CoverageMesh makeSharedEdgeCheck() {
+    CoverageMesh mesh{ "shared edge", {}, {}, 100, 100, 612, 612 };
+    mesh.points = { vec4(100.5f, 100.5f, 0.f), vec4(612.5f, 100.5f, 0.f), vec4(612.5f, 612.5f, 0.f), vec4(100.5f, 612.5f, 0.f) };
+    mesh.triangles = { triIndices(0, 1, 2), triIndices(0, 2, 3) };
+    return mesh;
+}
+
+// A fan of thin triangles around a vertex on a pixel centre, out to points spaced 1.25 pixels
+// apart around a square. Most spokes pass through pixel centres and many triangles cover none.
+// Input Variables:
+// - spokesPerSide: Number of triangles along each side of the square
+inline CoverageMesh makeFanCheck(int spokesPerSide) {
+    CoverageMesh mesh{ "fan", {}, {}, 100, 100, 600, 600 };
+    const float lo = 100.5f, hi = 600.5f, step = (hi - lo) / spokesPerSide;
+    mesh.points.push_back(vec4(350.5f, 350.5f, 0.f));
+
+    // Around the square clockwise on screen, from the top-left corner
+    for (int i = 0; i < spokesPerSide; i++) mesh.points.push_back(vec4(lo + i * step, lo, 0.f));
+    for (int i = 0; i < spokesPerSide; i++) mesh.points.push_back(vec4(hi, lo + i * step, 0.f));
+    for (int i = 0; i < spokesPerSide; i++) mesh.points.push_back(vec4(hi - i * step, hi, 0.f));
+    for (int i = 0; i < spokesPerSide; i++) mesh.points.push_back(vec4(lo, hi - i * step, 0.f));
+
+    unsigned int rim = 4 * spokesPerSide;
+    for (unsigned int i = 0; i < rim; i++)
+        mesh.triangles.push_back(triIndices(0, 1 + i, 1 + (i + 1) % rim));
+    return mesh;
+}
+
+// A grid of cells split into two triangles each, the diagonal alternating between cells.
+// Vertices inside the grid are jittered by up to a fifth of a cell, and some are moved onto
+// pixel centres so edges and vertices land exactly on them; vertices on the border stay on it.
+// Input Variables:
+// - name: Name reported for the check
+// - cells: Number of cells along each side
+// - cellSize: Size of a cell in pixels, cells * cellSize must be a whole number of pixels
+inline CoverageMesh makeGridCheck(const std::string& name, int cells, float cellSize) {
+    int size = (int)(cells * cellSize);
+    CoverageMesh mesh{ name, {}, {}, 100, 100, 100 + size, 100 + size };
+    RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
+    const float origin = 100.5f, jitter = 0.2f * cellSize;
+
+    for (int j = 0; j <= cells; j++) {
+        for (int i = 0; i <= cells; i++) {
+            float x = origin + i * cellSize, y = origin + j * cellSize;
+            if (i > 0 && i < cells) x += rng.getRandomFloat(-jitter, jitter);
+            if (j > 0 && j < cells) y += rng.getRandomFloat(-jitter, jitter);
+            if (i > 0 && i < cells && j > 0 && j < cells && (i + j) % 3 == 0 && cellSize > 4.f) {
+                x = std::floor(x) + 0.5f;
+                y = std::floor(y) + 0.5f;
+            }
+            mesh.points.push_back(vec4(x, y, 0.f));
+        }
+    }
+
+    for (int j = 0; j < cells; j++) {
+        for (int i = 0; i < cells; i++) {
+            unsigned int p00 = j * (cells + 1) + i, p10 = p00 + 1, p01 = p00 + cells + 1, p11 = p01 + 1;
+            if ((i + j) & 1) {
+                mesh.triangles.push_back(triIndices(p00, p10, p11));
+                mesh.triangles.push_back(triIndices(p00, p11, p01));
+            }
+            else {
+                mesh.triangles.push_back(triIndices(p00, p10, p01));
+                mesh.triangles.push_back(triIndices(p10, p11, p01));
+            }
+        }
+    }
+    return mesh;
+}
+
+// Two triangles splitting a square that reaches past the screen, so each covers whole tiles
+// and its bounds are clamped to every tile it is drawn in. The square is split from its top-right
+// to its bottom-left corner, so the shared edge passes far from pixel (0, 0) and its fixed-point
+// value there needs more than 32 bits.
+// Input Variables:
+// - name: Name reported for the check
+// - x0, y0: Pixel whose centre is the top-left corner of the square
+// - x1, y1: Pixel whose centre is the bottom-right corner
+inline CoverageMesh makeLargeCheck(const std::string& name, int x0, int y0, int x1, int y1) {
+    CoverageMesh mesh{ name, {}, {}, x0, y0, x1, y1 };
+    float left = x0 + 0.5f, top = y0 + 0.5f, right = x1 + 0.5f, bottom = y1 + 0.5f;
+    mesh.points = { vec4(left, top, 0.f), vec4(right, top, 0.f), vec4(right, bottom, 0.f), vec4(left, bottom, 0.f) };
+    mesh.triangles = { triIndices(0, 1, 3), triIndices(1, 2, 3) };
+    return mesh;
+}
+
+// Pixels drawn wrongly by one pass over a check mesh
+struct CoverageErrors {
+    unsigned int missing = 0; // Inside the rectangle, not shaded
+    unsigned int twice = 0;   // Shaded more than once
+    unsigned int outside = 0; // Outside the rectangle, shaded
+
+    bool ok() const { return missing == 0 && twice == 0 && outside == 0; }
+};
+
+// Draws a check mesh into a cleared canvas and compares how often every pixel was shaded
+// Input Variables:
+// - renderer: Headless renderer, its overdraw heatmap counts the shaded pixels
+// - mesh: Triangles to draw
+// - tiled: Draw one tile at a time instead of each triangle whole
+// Returns the pixels shaded the wrong number of times
+inline CoverageErrors drawCoverageCheck(Renderer& renderer, const CoverageMesh& mesh, bool tiled) {
+    Light L{ vec4(0.f, 0.f, 1.f, 0.f), colour(1.0f, 1.0f, 1.0f), colour(0.1f, 0.1f, 0.1f) };
+    int width = (int)renderer.canvas.getWidth(), height = (int)renderer.canvas.getHeight();
+
+    // Set up every triangle as the pipeline does, dropping those it would not bin
+    std::vector<TriSetup> setups;
+    std::vector<TriAttributes> attributes;
+    float depth = 0.9f, step = 0.8f / mesh.triangles.size();
+    for (const triIndices& ind : mesh.triangles) {
+        Vertex v[3];
+        for (unsigned int i = 0; i < 3; i++) {
+            v[i].p = vec4(mesh.points[ind.v[i]][0], mesh.points[ind.v[i]][1], depth, 1.f);
+            v[i].normal = vec4(0.f, 0.f, 1.f, 0.f);
+            v[i].rgb = colour(1.f, 1.f, 1.f);
+        }
+        depth -= step;
+
+        TriSetup setup(v[0], v[1], v[2]);
+        int sx0, sy0, sx1, sy1;
+        setup.getSampleBounds(sx0, sy0, sx1, sy1);
+        if (setup.area <= 0.f || sx0 >= sx1 || sy0 >= sy1) continue;
+        setups.push_back(setup);
+        attributes.emplace_back(v[0], v[1], v[2]);
+    }
+
+    renderer.clear();
+    int tileSize = tiled ? TileBins::tileSize : max(width, height);
+    for (int ty = 0; ty < height; ty += tileSize) {
+        for (int tx = 0; tx < width; tx += tileSize) {
+            int x1 = min(tx + tileSize, width), y1 = min(ty + tileSize, height);
+            for (size_t t = 0; t < setups.size(); t++) {
+                int sx0, sy0, sx1, sy1;
+                setups[t].getSampleBounds(sx0, sy0, sx1, sy1);
+                if (sx1 <= tx || sx0 >= x1 || sy1 <= ty || sy0 >= y1) continue;
+                triangle tri(setups[t], attributes[t]);
+                if (renderer.visibilityBuffer) tri.drawVisibility(renderer, (unsigned int)t, tx, ty, x1, y1);
+                else tri.draw(renderer, L, attributes[t].kd, tx, ty, x1, y1);
+            }
+        }
+    }
+
+    CoverageErrors errors;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            unsigned char count = renderer.overdraw[y * width + x];
+            bool inside = x >= mesh.x0 && x < mesh.x1 && y >= mesh.y0 && y < mesh.y1;
+            if (count > 1) errors.twice++;
+            else if (inside && count == 0) errors.missing++;
+            else if (!inside && count == 1) errors.outside++;
+        }
+    }
+    return errors;
+}
+
+// Runs every check mesh with every kernel and writes one line per pass
+// Input Variables:
+// - renderer: Headless renderer to draw with, its options are restored afterwards
+// - os: Stream the results are written to
+// Returns the number of passes that shaded a pixel the wrong number of times
+inline unsigned int checkRasterCoverage(Renderer& renderer, std::ostream& os) {
+    RandomNumberGenerator::getInstance().seed(1);
+    std::vector<CoverageMesh> meshes = {
+        makeSharedEdgeCheck(),
+        makeFanCheck(400),
+        makeGridCheck("grid", 40, 15.375f),
+        makeGridCheck("sub-pixel grid", 300, 1.25f),
+        makeGridCheck("tiny grid", 400, 0.75f),
+        makeLargeCheck("large", -301, -301, 1300, 1300),
+        // Thousands of pixels across, but its sample bounds reach only 2x2 pixels into the tile
+        // holding the corner, where the edge values no longer fit in 32 bits
+        makeLargeCheck("large corner", -3001, -3001, 65, 65)
+    };
+
+    bool heatmap = renderer.overdrawHeatmap, visibility = renderer.visibilityBuffer;
+    SimdLevel level = simdLevel();
+    renderer.overdrawHeatmap = true;
+
+    unsigned int failures = 0;
+    for (CoverageMesh& mesh : meshes) {
+        mesh.x0 = max(mesh.x0, 0);
+        mesh.y0 = max(mesh.y0, 0);
+        mesh.x1 = min(mesh.x1, (int)renderer.canvas.getWidth());
+        mesh.y1 = min(mesh.y1, (int)renderer.canvas.getHeight());
+
+        for (int l = 0; l <= static_cast<int>(detectSimdLevel()); l++) {
+            simdLevel() = static_cast<SimdLevel>(l);
+            for (int pass = 0; pass < 4; pass++) {
+                renderer.visibilityBuffer = (pass & 1) != 0;
+                bool tiled = (pass & 2) != 0;
+                CoverageErrors errors = drawCoverageCheck(renderer, mesh, tiled);
+                os << mesh.name << ", " << mesh.triangles.size() << " triangles, " << simdName(static_cast<SimdLevel>(l))
+                   << (renderer.visibilityBuffer ? " visibility" : " forward") << (tiled ? " tiled: " : " whole: ");
+                if (errors.ok()) {
+                    os << "ok\n";
+                }
+                else {
+                    os << errors.missing << " missing, " << errors.twice << " twice, " << errors.outside << " outside\n";
+                    failures++;
+                }
+            }
+        }
+    }
+
+    renderer.overdrawHeatmap = heatmap;
+    renderer.visibilityBuffer = visibility;
+    simdLevel() = level;
+    return failures;
+}
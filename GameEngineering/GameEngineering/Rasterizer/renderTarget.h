@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "platform.h"
+#include "alignedArray.h"
+#include "simd.h"
+
+// Pixel layouts of the back buffer
+enum class PixelFormat {
+    RGB24,  // 3 bytes per pixel, the layout of the window's back buffer and of PPM files
+    BGRA32  // One 32-bit word per pixel, 0xAARRGGBB, aligned for SIMD loads and stores
+};
+
+// Packs a colour into a BGRA32 pixel with full alpha
+inline unsigned int packColour(unsigned char r, unsigned char g, unsigned char b) {
+    return 0xFF000000u | ((unsigned int)r << 16) | ((unsigned int)g << 8) | b;
+}
+
+// Fills BGRA32 pixels with one colour, 8 pixels per store. Nothing past the last pixel is
+// written, so neighbouring ranges can be filled by different threads.
+// Input Variables:
+// - pixels: First pixel
+// - count: Number of pixels
+// - value: Packed colour
+SIMD_TARGET_AVX2 inline void fillPixelsAVX2(unsigned int* pixels, size_t count, unsigned int value) {
+    __m256i v = _mm256_set1_epi32((int)value);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_si256((__m256i*)(pixels + i), v);
+    for (; i < count; i++)
+        pixels[i] = value;
+}
+
+// 4 pixels per store, same inputs as fillPixelsAVX2
+SIMD_TARGET_SSE41 inline void fillPixelsSSE41(unsigned int* pixels, size_t count, unsigned int value) {
+    __m128i v = _mm_set1_epi32((int)value);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_si128((__m128i*)(pixels + i), v);
+    for (; i < count; i++)
+        pixels[i] = value;
+}
+
+// Fills BGRA32 pixels with the fastest kernel the CPU supports, inputs as for fillPixelsAVX2
+inline void fillPixels(unsigned int* pixels, size_t count, unsigned int value) {
+    switch (simdLevel()) {
+    case SimdLevel::AVX2: fillPixelsAVX2(pixels, count, value); break;
+    case SimdLevel::SSE41: fillPixelsSSE41(pixels, count, value); break;
+    default: for (size_t i = 0; i < count; i++) pixels[i] = value; break;
+    }
+}
+
+// Converts BGRA32 pixels to RGB24, dropping alpha
+// Input Variables:
+// - src: Packed pixels
+// - count: Number of pixels
+// - first: First pixel to convert, the kernels below finish their tails here
+// Output Variables:
+// - dst: 3 * count bytes
+inline void packedToRGB24Scalar(const unsigned int* src, unsigned char* dst, size_t count, size_t first = 0) {
+    for (size_t i = first; i < count; i++) {
+        unsigned int p = src[i];
+        dst[i * 3] = (unsigned char)(p >> 16);
+        dst[i * 3 + 1] = (unsigned char)(p >> 8);
+        dst[i * 3 + 2] = (unsigned char)p;
+    }
+}
+
+// 4 pixels per shuffle. Each store writes 16 bytes for 12 of output, so the loop stops
+// while the 4 spare bytes still land on pixels that are converted afterwards.
+SIMD_TARGET_SSE41 inline void packedToRGB24SSE41(const unsigned int* src, unsigned char* dst, size_t count) {
+    const __m128i order = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; i + 6 <= count; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i * 3), _mm_shuffle_epi8(p, order));
+    }
+    packedToRGB24Scalar(src, dst, count, i);
+}
+
+// 8 pixels per shuffle, the two 12-byte halves are joined by a cross-lane permute into
+// 24 bytes of a 32-byte store
+SIMD_TARGET_AVX2 inline void packedToRGB24AVX2(const unsigned int* src, unsigned char* dst, size_t count) {
+    const __m256i order = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 11 <= count; i += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i rgb = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p, order), join);
+        _mm256_storeu_si256((__m256i*)(dst + i * 3), rgb);
+    }
+    packedToRGB24Scalar(src, dst, count, i);
+}
+
+// Converts BGRA32 pixels to RGB24 with the fastest kernel the CPU supports, as packedToRGB24Scalar
+inline void packedToRGB24(const unsigned int* src, unsigned char* dst, size_t count) {
+    switch (simdLevel()) {
+    case SimdLevel::AVX2: packedToRGB24AVX2(src, dst, count); break;
+    case SimdLevel::SSE41: packedToRGB24SSE41(src, dst, count); break;
+    default: packedToRGB24Scalar(src, dst, count); break;
+    }
+}
+
+// Surface the renderer draws into: a framebuffer, plus presentation and input.
+// Pixel writes go straight to the framebuffer and are not virtual, so the backend only
+// matters once per frame in present(). Backends differ only in where the frame ends up.
+//
+// The back buffer is either the RGB24 image itself or, by default, a packed BGRA32 buffer
+// that shading kernels write with one 32-bit or vector store per pixel. A packed frame is
+// converted to the RGB24 image only when it is needed: when a window presents it, or when
+// backBuffer() or savePPM() read it.
+class RenderTarget {
+protected:
+    unsigned char* image = nullptr;  // RGB24 image, 3 bytes per pixel
+    unsigned int width = 0;          // Framebuffer width in pixels
+    unsigned int height = 0;         // Framebuffer height in pixels
+    AlignedArray<unsigned int> packed; // BGRA32 back buffer, empty in RGB24 mode
+    unsigned int* pixels = nullptr;  // Start of packed, null in RGB24 mode
+
+    // Brings the RGB24 image up to date with the packed back buffer
+    void convertToRGB24() {
+        if (pixels) packedToRGB24(pixels, image, (size_t)width * height);
+    }
+
+public:
+    virtual ~RenderTarget() {}
+
+    // Shows the finished frame
+    virtual void present() = 0;
+
+    // Processes pending input events
+    virtual void checkInput() {}
+
+    // Checks if a specific key is currently pressed, targets without input report no keys
+    virtual bool keyPressed([[maybe_unused]] int key) { return false; }
+
+    // Selects the layout of the back buffer. The current frame is not carried over.
+    // Input Variables:
+    // - format: New pixel format
+    void setPixelFormat(PixelFormat format) {
+        if (format == PixelFormat::BGRA32) {
+            packed.resize((size_t)width * height);
+            pixels = packed.get();
+        }
+        else {
+            pixels = nullptr;
+        }
+    }
+
+    PixelFormat getPixelFormat() const { return pixels ? PixelFormat::BGRA32 : PixelFormat::RGB24; }
+
+    // Returns a pointer to the RGB24 image of the frame, converted from the packed back buffer first
+    unsigned char* backBuffer() {
+        convertToRGB24();
+        return image;
+    }
+
+    // Returns the first pixel of row y of the packed back buffer, or null in RGB24 mode
+    unsigned int* packedRow(int y) { return pixels ? pixels + (size_t)y * width : nullptr; }
+
+    unsigned int getWidth() const { return width; }
+    unsigned int getHeight() const { return height; }
+
+    // Draws a pixel at (x, y) with the specified RGB color
+    void draw(int x, int y, unsigned char r, unsigned char g, unsigned char b) {
+        if (pixels) {
+            pixels[y * width + x] = packColour(r, g, b);
+            return;
+        }
+        int index = ((y * width) + x) * 3;
+        image[index] = r;
+        image[index + 1] = g;
+        image[index + 2] = b;
+    }
+
+    // Clears the back buffer by setting all pixels to black
+    void clear() {
+        clearRows(0, height);
+    }
+
+    // Clears a band of rows of the back buffer to black, bands can be cleared in parallel
+    // Input Variables:
+    // - y0, y1: First and last (exclusive) row of the band
+    void clearRows(unsigned int y0, unsigned int y1) {
+        if (pixels) fillPixels(pixels + (size_t)y0 * width, (size_t)(y1 - y0) * width, packColour(0, 0, 0));
+        else memset(image + (size_t)y0 * width * 3, 0, (size_t)(y1 - y0) * width * 3 * sizeof(unsigned char));
+    }
+
+    // Writes the frame to a binary PPM image
+    // Input Variables:
+    // - filename: Path of the image to write
+    // Returns true if the file was written
+    bool savePPM(const std::string& filename) {
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) return false;
+        file << "P6\n" << width << " " << height << "\n255\n";
+        file.write(reinterpret_cast<const char*>(backBuffer()), width * height * 3);
+        return static_cast<bool>(file);
+    }
+};
+
+// Framebuffer in ordinary memory. present() does nothing, so frames are never throttled by
+// vsync or a swap chain (nor pay for converting a packed frame that nobody reads), which
+// suits batch rendering and benchmarking on any platform.
+class MemoryTarget : public RenderTarget {
+    std::vector<unsigned char> rgb; // Storage for the RGB24 image
+
+public:
+    // Constructor allocating a cleared framebuffer
+    // Input Variables:
+    // - w, h: Framebuffer dimensions in pixels
+    MemoryTarget(unsigned int w, unsigned int h) : rgb(w * h * 3, 0) {
+        width = w;
+        height = h;
+        image = rgb.data();
+        setPixelFormat(PixelFormat::BGRA32);
+    }
+
+    void present() override {}
+};
+
+#if defined(_WIN32)
+// Win32 window presented through D3D11, the RGB24 image is the window's back buffer
+class WindowTarget : public RenderTarget {
+    GamesEngineeringBase::Window window;
+
+public:
+    // Constructor opening the window
+    // Input Variables:
+    // - w, h: Window dimensions in pixels
+    // - title: Window title
+    WindowTarget(unsigned int w, unsigned int h, const std::string& title) {
+        window.create(w, h, title);
+        width = window.getWidth();
+        height = window.getHeight();
+        image = window.backBuffer();
+        setPixelFormat(PixelFormat::BGRA32);
+    }
+
+    void present() override {
+        convertToRGB24();
+        window.present();
+    }
+    void checkInput() override { window.checkInput(); }
+    bool keyPressed(int key) override { return window.keyPressed(key); }
+};
+#endif
@@ -1,9 +1,13 @@
 #pragma once
 #define _USE_MATH_DEFINES
 #include <cmath>
-#include "GamesEngineeringBase.h"
+#include <memory>
+#include <vector>
+#include "renderTarget.h"
 #include "zbuffer.h"
 #include "matrix.h"
+#include "profiler.h"
+#include "threadPool.h"
 
 // The `Renderer` class handles rendering operations, including managing the
 // Z-buffer, canvas, and perspective transformations for a 3D scene.
@@ -12,26 +16,84 @@ class Renderer {
     float aspect = 4.0f / 3.0f;        // Aspect ratio of the canvas (width/height)
     float n = 0.1f;                    // Near clipping plane distance
     float f = 100.0f;                  // Far clipping plane distance
+    std::unique_ptr<RenderTarget> target; // Backend owning the framebuffer
+    static const size_t clearBand = 64;   // Rows cleared by one job of a parallel clear
 public:
     Zbuffer<float> zbuffer;                  // Z-buffer for depth management
-    GamesEngineeringBase::Window canvas;     // Canvas for rendering the scene
+    RenderTarget& canvas;                    // Canvas for rendering the scene
     matrix perspective;                      // Perspective projection matrix
 
+    // Options of the multithreaded pipeline (renderSceneMT)
+    bool measureOverdraw = false;            // Count pixels shaded then overwritten, costs a pass over the Z-buffer per frame
+    bool overdrawHeatmap = false;            // Debug view: show how often each pixel was shaded instead of its colour
+    std::vector<unsigned char> overdraw;     // Times each pixel was shaded this frame, kept only for the heatmap
+    bool visibilityBuffer = false;           // Rasterize depth and triangle IDs only, then shade every visible pixel once
+    bool frontToBack = true;                 // Sort draw items and tile bins by depth so hidden pixels fail the depth test early
+    bool depthPrepass = false;               // Rasterize depth only before shading, so each pixel is shaded once (ignored with visibilityBuffer)
+    bool occlusionCulling = true;            // Cull draw items hidden behind occluder meshes (Mesh::occluder)
+    bool lazyDepthClear = true;              // Clear Z-buffer tiles when first drawn to instead of all of them every frame
+    std::vector<unsigned int> visibility;    // Triangle ID of each pixel, only meaningful where the Z-buffer was written
+
     // Constructor initializes the canvas, Z-buffer, and perspective projection matrix.
-    Renderer() {
-        canvas.create(1024, 768, "Raster");  // Create a canvas with specified dimensions and title
-        zbuffer.create(1024, 768);           // Initialize the Z-buffer with the same dimensions
+    // Input Variables:
+    // - headless: Render into memory instead of a window, always the case outside Windows
+    Renderer(bool headless = false) : target(createTarget(headless, 1024, 768)), canvas(*target) {
+        zbuffer.create(canvas.getWidth(), canvas.getHeight()); // Initialize the Z-buffer with the same dimensions
         perspective = matrix::makePerspective(fov, aspect, n, f); // Set up the perspective matrix
     }
 
+    // Creates a window, or an in-memory target when headless or not on Windows
+    // Input Variables:
+    // - headless: Skip the window, only read on Windows since other platforms have no window backend
+    // - w, h: Size of the framebuffer in pixels
+    static std::unique_ptr<RenderTarget> createTarget([[maybe_unused]] bool headless, unsigned int w, unsigned int h) {
+#if defined(_WIN32)
+        if (!headless)
+            return std::make_unique<WindowTarget>(w, h, "Raster");
+#endif
+        return std::make_unique<MemoryTarget>(w, h);
+    }
+
     // Clears the canvas and resets the Z-buffer.
+    // Full clears are split into bands of rows run on the thread pool; call while the pool is idle.
     void clear() {
-        canvas.clear();  // Clear the canvas (sets all pixels to the background color)
-        zbuffer.clear(); // Reset the Z-buffer to the farthest depth
+        ThreadPool& pool = ThreadPool::getInstance();
+        {
+            PROFILE_SCOPE("clear canvas");
+            // Clear the canvas (sets all pixels to the background color)
+            pool.parallelFor(0, canvas.getHeight(), clearBand, [&](size_t y0, size_t y1) {
+                canvas.clearRows((unsigned int)y0, (unsigned int)y1);
+            });
+        }
+        PROFILE_SCOPE("clear zbuffer");
+        // Reset the Z-buffer to the farthest depth, at once or tile by tile as the frame draws
+        if (lazyDepthClear) {
+            zbuffer.resetTiles(false);
+        }
+        else {
+            pool.parallelFor(0, canvas.getHeight(), clearBand, [&](size_t y0, size_t y1) {
+                zbuffer.clearRows((unsigned int)y0, (unsigned int)y1);
+            });
+            zbuffer.resetTiles(true);
+        }
+        if (overdrawHeatmap)
+            overdraw.assign(canvas.getWidth() * canvas.getHeight(), 0);
+        // IDs are never cleared: a pixel holds a valid ID exactly when its depth is below the cleared 1.0
+        if (visibilityBuffer)
+            visibility.resize(canvas.getWidth() * canvas.getHeight());
+    }
+
+    // Records that a pixel was shaded, for the overdraw heatmap
+    // Input Variables:
+    // - x, y: Pixel coordinates
+    void countOverdraw(int x, int y) {
+        unsigned char& count = overdraw[y * canvas.getWidth() + x];
+        if (count < 255) count++;
     }
 
     // Presents the current canvas frame to the display.
     void present() {
+        PROFILE_SCOPE("present");
         canvas.present(); // Display the rendered frame
     }
 };
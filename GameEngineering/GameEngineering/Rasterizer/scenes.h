@@ -0,0 +1,348 @@
+#pragma once
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <string>
+#include <vector>
+#include "matrix.h"
+#include "colour.h"
+#include "mesh.h"
+#include "RNG.h"
+#include "light.h"
+#include "instancing.h"
+
+// Utility function to generate a random rotation matrix
+// No input variables
+inline matrix makeRandomRotation() {
+    RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
+    unsigned int r = rng.getRandomInt(0, 3);
+
+    switch (r) {
+    case 0: return matrix::makeRotateX(rng.getRandomFloat(0.f, 2.0f * M_PI));
+    case 1: return matrix::makeRotateY(rng.getRandomFloat(0.f, 2.0f * M_PI));
+    case 2: return matrix::makeRotateZ(rng.getRandomFloat(0.f, 2.0f * M_PI));
+    default: return matrix::makeIdentity();
+    }
+}
+
+struct RandRot {
+    float rx;
+    float ry;
+    float rz;
+};
+
+// An animated scene: its objects, camera and light, advanced one frame at a time.
+// Scenes only move objects, drawing is left to the caller, so the same scene runs in the
+// interactive loop and in the benchmark. Random placement comes from the RandomNumberGenerator
+// singleton, seed it before constructing a scene to get the same scene every run.
+class Scene {
+public:
+    std::vector<Mesh*> meshes;             // Individually allocated meshes, owned by the scene
+    std::vector<InstancedMesh*> instanced; // Instanced meshes, owned by the scene
+    matrix camera = matrix::makeIdentity();
+    Light L{ vec4(0.f, 1.f, 1.f, 0.f), colour(1.0f, 1.0f, 1.0f), colour(0.1f, 0.1f, 0.1f) };
+
+    Scene() {}
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    virtual ~Scene() {
+        for (Mesh* m : meshes)
+            delete m;
+        for (InstancedMesh* m : instanced)
+            delete m;
+    }
+
+    // Name used in reports
+    virtual std::string name() const = 0;
+
+    // Advances the animation by one frame
+    // Returns true when the animation turned around, two turns make one full cycle
+    virtual bool update() = 0;
+};
+
+// Two rows of 40 cubes with random rotations, the camera moving along them
+class Scene1 : public Scene {
+    InstancedMesh* cubes;  // All cubes share one cube geometry
+    float zoffset = 8.0f;  // Camera Z-offset
+    float step = -0.1f;    // Step size for camera movement
+
+public:
+    Scene1() {
+        cubes = new InstancedMesh(Mesh::makeCube(1.f));
+        instanced.push_back(cubes);
+        for (unsigned int i = 0; i < 20; i++) {
+            cubes->add(matrix::makeTranslation(-2.0f, 0.0f, (-3 * static_cast<float>(i))) * makeRandomRotation());
+            cubes->add(matrix::makeTranslation(2.0f, 0.0f, (-3 * static_cast<float>(i))) * makeRandomRotation());
+        }
+    }
+
+    std::string name() const override { return "scene1"; }
+
+    bool update() override {
+        camera = matrix::makeTranslation(0, 0, -zoffset); // Update camera position
+
+        // Rotate the first two cubes in the scene
+        cubes->instances[0].world = cubes->instances[0].world.multiplyAffine(matrix::makeRotateXYZ(0.1f, 0.1f, 0.0f));
+        cubes->instances[1].world = cubes->instances[1].world.multiplyAffine(matrix::makeRotateXYZ(0.0f, 0.1f, 0.2f));
+
+        zoffset += step;
+        if (zoffset < -60.f || zoffset > 8.f) {
+            step *= -1.f;
+            return true;
+        }
+        return false;
+    }
+};
+
+// A grid of rotating cubes and a sphere moving across it
+class Scene2 : public Scene {
+    std::vector<matrix> spins;      // Rotation increment of each cube, built once from its random angles
+    Mesh* sphere;
+    float sphereOffset = -6.f;
+    float sphereStep = 0.1f;
+
+public:
+    Scene2() {
+        RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
+
+        // Create a grid of cubes with random rotations
+        for (unsigned int y = 0; y < 6; y++) {
+            for (unsigned int x = 0; x < 8; x++) {
+                Mesh* m = new Mesh();
+                *m = Mesh::makeCube(1.f);
+                meshes.push_back(m);
+                m->world = matrix::makeTranslation(-7.0f + (static_cast<float>(x) * 2.f), 5.0f - (static_cast<float>(y) * 2.f), -8.f);
+                RandRot r{ rng.getRandomFloat(-.1f, .1f), rng.getRandomFloat(-.1f, .1f), rng.getRandomFloat(-.1f, .1f) };
+                spins.push_back(matrix::makeRotateXYZ(r.rx, r.ry, r.rz));
+            }
+        }
+
+        // Create a sphere and add it to the scene
+        sphere = new Mesh();
+        *sphere = Mesh::makeSphere(1.0f, 10, 20);
+        meshes.push_back(sphere);
+        sphere->world = matrix::makeTranslation(sphereOffset, 0.f, -6.f);
+    }
+
+    std::string name() const override { return "scene2"; }
+
+    bool update() override {
+        // Rotate each cube in the grid
+        for (unsigned int i = 0; i < spins.size(); i++)
+            meshes[i]->world = meshes[i]->world.multiplyAffine(spins[i]);
+
+        // Move the sphere back and forth
+        sphereOffset += sphereStep;
+        sphere->world = matrix::makeTranslation(sphereOffset, 0.f, -6.f);
+        if (sphereOffset > 6.0f || sphereOffset < -6.0f) {
+            sphereStep *= -1.f;
+            return true;
+        }
+        return false;
+    }
+};
+
+// A block of rotating cubes, DIM cubes along each axis, with the camera flying through it
+class CubeBlock : public Scene {
+    InstancedMesh* cubes;           // All cubes share one cube geometry
+    std::vector<matrix> spins;      // Rotation increment of each cube, built once from its random angles
+    float zoffset = 0.0f;           // Camera Z-offset, moves the camera in/out along the Z-axis
+    float step = 0.2f;              // Move speed for the camera
+    float nearZ, farZ;              // Camera turns around past these offsets
+    float distance;                 // Camera distance from the block center at zoffset 0
+
+public:
+    // Constructor building the block
+    // Input Variables:
+    // - dim: Number of cubes along each axis
+    // - spacing: Distance between the centers of neighbouring cubes
+    CubeBlock(unsigned int dim, float spacing) {
+        RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
+        cubes = new InstancedMesh(Mesh::makeCube(1.0f)); // Each sub-cube is size 1
+        instanced.push_back(cubes);
+
+        // Center the large cube shape around the origin by offsetting
+        float startOffset = -((dim - 1) * spacing) * 0.5f;
+
+        for (unsigned int x = 0; x < dim; x++) {
+            for (unsigned int y = 0; y < dim; y++) {
+                for (unsigned int z = 0; z < dim; z++) {
+                    // Position the sub-cube so that the entire group forms a larger cube
+                    float px = startOffset + x * spacing;
+                    float py = startOffset + y * spacing;
+                    float pz = startOffset + z * spacing;
+
+                    // Apply a random initial rotation
+                    cubes->add(matrix::makeTranslation(px, py, pz) * makeRandomRotation());
+
+                    // Random small rotation increments around X/Y/Z
+                    RandRot rr{
+                        rng.getRandomFloat(-0.05f, 0.05f),
+                        rng.getRandomFloat(-0.05f, 0.05f),
+                        rng.getRandomFloat(-0.05f, 0.05f)
+                    };
+                    spins.push_back(matrix::makeRotateXYZ(rr.rx, rr.ry, rr.rz));
+                }
+            }
+        }
+
+        // Sweep from just in front of the block to its center, scene3's 8^3 block gives 10 and -40
+        float extent = dim * spacing;
+        distance = 25.f * extent / 20.f;
+        farZ = 10.f * extent / 20.f;
+        nearZ = -40.f * extent / 20.f;
+    }
+
+    std::string name() const override { return "cubes"; }
+
+    bool update() override {
+        bool turned = false;
+
+        // Update camera position, reversing direction if we go too far
+        zoffset += step;
+        if (zoffset > farZ || zoffset < nearZ) {
+            step *= -1.f;
+            turned = true;
+        }
+
+        camera = matrix::makeTranslation(0.f, 0.f, -distance - zoffset);
+
+        // Rotate each sub-cube by its small random increments
+        for (unsigned int i = 0; i < cubes->instances.size(); i++)
+            cubes->instances[i].world = cubes->instances[i].world.multiplyAffine(spins[i]);
+        return turned;
+    }
+};
+
+// Scene with a large block of 8 x 8 x 8 rotating cubes and a camera flying through it
+class Scene3 : public CubeBlock {
+public:
+    Scene3() : CubeBlock(8, 2.5f) {}
+
+    std::string name() const override { return "scene3"; }
+};
+
+// Stress scene: a row of spinning spheres, each with many small triangles
+class SphereScene : public Scene {
+    float angle = 0.f;
+
+public:
+    // Constructor building the spheres
+    // Input Variables:
+    // - count: Number of spheres
+    // - tessellation: Latitude divisions of each sphere, with twice as many longitude divisions
+    SphereScene(unsigned int count, int tessellation) {
+        InstancedMesh* spheres = new InstancedMesh(Mesh::makeSphere(1.0f, tessellation, 2 * tessellation));
+        instanced.push_back(spheres);
+
+        // Spread the spheres evenly across the view
+        float spacing = 2.2f;
+        float startOffset = -((count - 1) * spacing) * 0.5f;
+        for (unsigned int i = 0; i < count; i++)
+            spheres->add(matrix::makeTranslation(startOffset + i * spacing, 0.f, 0.f));
+        camera = matrix::makeTranslation(0.f, 0.f, -max(3.f, count * spacing * 0.4f));
+    }
+
+    std::string name() const override { return "spheres"; }
+
+    bool update() override {
+        angle += 0.02f;
+        matrix spin = matrix::makeRotateXYZ(angle, 2.f * angle, 0.f); // Shared by every sphere
+        for (Instance& instance : instanced[0]->instances) {
+            vec4 position(instance.world(0, 3), instance.world(1, 3), instance.world(2, 3));
+            instance.world = matrix::makeTranslation(position[0], position[1], position[2]).multiplyAffine(spin);
+        }
+        if (angle >= 2.f * M_PI) {
+            angle = 0.f;
+            return true;
+        }
+        return false;
+    }
+};
+
+// Stress scene: full-screen rectangles stacked in depth, submitted back to front. In
+// submission order every layer passes the depth test and each pixel is shaded once per layer;
+// drawn front to back, only the nearest layer is shaded.
+class OverdrawScene : public Scene {
+    float offset = 0.f;
+    float step = 0.01f;
+
+public:
+    // Constructor building the layers
+    // Input Variables:
+    // - layers: Number of full-screen rectangles
+    OverdrawScene(unsigned int layers) {
+        for (unsigned int i = 0; i < layers; i++) {
+            // Farthest first, each rectangle large enough to cover the 90 degree, 4:3 view at its depth
+            float z = 2.f + 0.1f * (layers - 1 - i);
+            Mesh* m = new Mesh();
+            *m = Mesh::makeRectangle(-z * 1.5f, -z * 1.2f, z * 1.5f, z * 1.2f);
+            m->world = matrix::makeTranslation(0.f, 0.f, -z);
+            meshes.push_back(m);
+        }
+    }
+
+    std::string name() const override { return "overdraw"; }
+
+    bool update() override {
+        // Sway the camera slightly so frames are not identical
+        offset += step;
+        camera = matrix::makeTranslation(offset, 0.f, 0.f);
+        if (offset > 0.2f || offset < -0.2f) {
+            step *= -1.f;
+            return true;
+        }
+        return false;
+    }
+};
+
+// Stress scene for occlusion culling: a street of tall facades hiding a crowd of small cubes,
+// with the camera moving along the street. The facades are occluders, so only the cubes seen
+// through the gaps between them are transformed and drawn.
+class CityScene : public Scene {
+    float offset = 0.f;
+    float step = 0.1f;
+    float range;          // Camera turns around this far from the middle of the street
+
+public:
+    // Constructor building the street
+    // Input Variables:
+    // - buildings: Number of facades along the street
+    // - objects: Number of cubes behind the facades
+    CityScene(unsigned int buildings, unsigned int objects) {
+        RandomNumberGenerator& rng = RandomNumberGenerator::getInstance();
+        const float width = 6.f, gap = 1.5f;
+        float street = buildings * (width + gap);
+        range = max(street * 0.5f - 10.f, 1.f);
+
+        // Facades tall enough to fill the view from the street, all sharing one occluder geometry
+        Mesh facade = Mesh::makeRectangle(-width * 0.5f, -15.f, width * 0.5f, 15.f);
+        facade.occluder = true;
+        InstancedMesh* facades = new InstancedMesh(facade);
+        instanced.push_back(facades);
+        for (unsigned int i = 0; i < buildings; i++)
+            facades->add(matrix::makeTranslation(-street * 0.5f + (i + 0.5f) * (width + gap), 0.f, -10.f));
+
+        InstancedMesh* crowd = new InstancedMesh(Mesh::makeCube(0.8f));
+        instanced.push_back(crowd);
+        for (unsigned int i = 0; i < objects; i++) {
+            float x = rng.getRandomFloat(-street * 0.5f, street * 0.5f);
+            float y = rng.getRandomFloat(-8.f, 8.f);
+            float z = rng.getRandomFloat(-40.f, -14.f);
+            crowd->add(matrix::makeTranslation(x, y, z) * makeRandomRotation());
+        }
+    }
+
+    std::string name() const override { return "city"; }
+
+    bool update() override {
+        offset += step;
+        camera = matrix::makeTranslation(-offset, 0.f, 0.f);
+        if (offset > range || offset < -range) {
+            step *= -1.f;
+            return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// Functions that use instructions beyond the x64 baseline are marked with these.
+// MSVC accepts any intrinsic in any function, GCC and Clang need a per-function target
+// so that one binary can contain every code path and pick one at runtime.
+#if defined(_MSC_VER)
+#define SIMD_TARGET_SSE41
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Instruction sets the rasterizer has kernels for, from slowest to fastest
+enum class SimdLevel { Scalar, SSE41, AVX2 };
+
+// Names of the SimdLevel values, in the same order, as given on command lines and in reports
+inline const char* const simdNames[] = { "scalar", "sse41", "avx2" };
+
+// Returns the name of a SimdLevel
+inline const char* simdName(SimdLevel level) { return simdNames[static_cast<int>(level)]; }
+
+// Queries the CPU (and the OS support for AVX state) for the best usable instruction set
+// Returns the fastest SimdLevel this machine can run
+inline SimdLevel detectSimdLevel() {
+    unsigned int regs[4] = { 0, 0, 0, 0 }; // eax, ebx, ecx, edx
+
+#if defined(_MSC_VER)
+    __cpuid(reinterpret_cast<int*>(regs), 0);
+    unsigned int maxLeaf = regs[0];
+    __cpuid(reinterpret_cast<int*>(regs), 1);
+#else
+    unsigned int maxLeaf = __get_cpuid_max(0, nullptr);
+    __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+
+    bool sse41 = (regs[2] & (1u << 19)) != 0;
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    bool avx = (regs[2] & (1u << 28)) != 0;
+    if (!sse41) return SimdLevel::Scalar;
+
+    // AVX registers are only usable if the OS saves them on a context switch
+    bool osAvx = false;
+    if (osxsave && avx) {
+#if defined(_MSC_VER)
+        unsigned long long xcr0 = _xgetbv(0);
+#else
+        unsigned int lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        unsigned long long xcr0 = ((unsigned long long)hi << 32) | lo;
+#endif
+        osAvx = (xcr0 & 6) == 6;
+    }
+
+    bool avx2 = false;
+    if (osAvx && maxLeaf >= 7) {
+#if defined(_MSC_VER)
+        __cpuidex(reinterpret_cast<int*>(regs), 7, 0);
+#else
+        __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+        avx2 = (regs[1] & (1u << 5)) != 0;
+    }
+
+    return avx2 ? SimdLevel::AVX2 : SimdLevel::SSE41;
+}
+
+// The instruction set used by the kernels, detected on first use.
+// Can be lowered at runtime, e.g. to compare the paths or to benchmark the scalar code.
+inline SimdLevel& simdLevel() {
+    static SimdLevel level = detectSimdLevel();
+    return level;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+#include "threadPool.h"
+
+// What the renderer did in a frame, from draw items down to pixels.
+// Every pool thread counts into its own copy (see localStats), padded to a cache line so
+// threads never share one; the copies are summed once the frame is done.
+struct alignas(64) RenderStats {
+    size_t drawItems = 0;              // Meshes and instances submitted
+    size_t visibleItems = 0;           // Draw items that survived frustum culling
+    size_t itemsOccluded = 0;          // Visible draw items hidden behind occluders, never transformed
+    size_t trianglesSubmitted = 0;     // Mesh triangles of every draw item
+    size_t trianglesFrustumCulled = 0; // Triangles of culled draw items, plus triangles fully outside one clip plane
+    size_t trianglesOccluded = 0;      // Triangles of occluded draw items
+    size_t trianglesClipped = 0;       // Triangles cut by the clipper against the near/far planes or guard band
+    size_t trianglesBackFacing = 0;    // Screen-space triangles wound away from the camera
+    size_t trianglesTooSmall = 0;      // Front-facing triangles with no area or no pixel centre in their bounds
+    size_t triangles = 0;              // Triangles sent to the raster phase
+    size_t pixelsTested = 0;           // Covered pixels that reached the depth test
+    size_t pixels = 0;                 // Pixels that passed the depth test and were shaded, or only stored in the visibility buffer
+    size_t pixelsOverwritten = 0;      // Shaded pixels covered again by a nearer surface later in the frame
+    size_t pixelsResolved = 0;         // Pixels shaded once by the visibility-buffer resolve pass
+
+    RenderStats& operator+=(const RenderStats& other) {
+        drawItems += other.drawItems;
+        visibleItems += other.visibleItems;
+        itemsOccluded += other.itemsOccluded;
+        trianglesSubmitted += other.trianglesSubmitted;
+        trianglesFrustumCulled += other.trianglesFrustumCulled;
+        trianglesOccluded += other.trianglesOccluded;
+        trianglesClipped += other.trianglesClipped;
+        trianglesBackFacing += other.trianglesBackFacing;
+        trianglesTooSmall += other.trianglesTooSmall;
+        triangles += other.triangles;
+        pixelsTested += other.pixelsTested;
+        pixels += other.pixels;
+        pixelsOverwritten += other.pixelsOverwritten;
+        pixelsResolved += other.pixelsResolved;
+        return *this;
+    }
+};
+
+// Counters of every pool thread, indexed by ThreadPool::workerIndex
+inline std::vector<RenderStats>& workerStats() {
+    static std::vector<RenderStats> stats(ThreadPool::getInstance().threadCount());
+    return stats;
+}
+
+// Counters of the calling thread
+inline RenderStats& localStats() {
+    return workerStats()[ThreadPool::workerIndex()];
+}
+
+// Zeroes the counters of every thread, call while the pool is idle
+inline void resetStats() {
+    for (RenderStats& stats : workerStats())
+        stats = RenderStats();
+}
+
+// Sums the counters of every thread, call while the pool is idle
+inline RenderStats gatherStats() {
+    RenderStats total;
+    for (const RenderStats& stats : workerStats())
+        total += stats;
+    return total;
+}
+
+// Writes the counters on a few human-readable lines
+// Input Variables:
+// - os: Stream to write to
+// - stats: Counters to print
+inline void printStats(std::ostream& os, const RenderStats& stats) {
+    os << "  draw items: " << stats.drawItems << " submitted, " << stats.visibleItems << " visible, "
+       << stats.itemsOccluded << " occluded\n";
+    os << "  triangles: " << stats.trianglesSubmitted << " submitted, " << stats.trianglesFrustumCulled << " frustum culled, "
+       << stats.trianglesOccluded << " occluded, "
+       << stats.trianglesClipped << " clipped, " << stats.trianglesBackFacing << " back-facing, "
+       << stats.trianglesTooSmall << " too small, " << stats.triangles << " rasterized\n";
+    os << "  pixels: " << stats.pixelsTested << " tested, " << stats.pixels << " shaded, "
+       << stats.pixelsOverwritten << " overwritten, " << stats.pixelsResolved << " resolved\n";
+}
+
+// Colour of a pixel in the overdraw heatmap: black where nothing was shaded, then blue,
+// green, yellow and red as the pixel is shaded more often, saturating at 8 times
+// Input Variables:
+// - count: Number of times the pixel was shaded
+// Output Variables:
+// - r, g, b: Heatmap colour
+inline void heatColour(unsigned int count, unsigned char& r, unsigned char& g, unsigned char& b) {
+    static const unsigned char ramp[9][3] = {
+        { 0, 0, 0 }, { 0, 0, 160 }, { 0, 96, 255 }, { 0, 200, 160 }, { 0, 220, 0 },
+        { 180, 230, 0 }, { 255, 200, 0 }, { 255, 100, 0 }, { 255, 0, 0 }
+    };
+    const unsigned char* c = ramp[count < 8 ? count : 8];
+    r = c[0];
+    g = c[1];
+    b = c[2];
+}
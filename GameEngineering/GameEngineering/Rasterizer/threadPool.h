@@ -1 +1,280 @@
 #pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "profiler.h"
+
+// Counts jobs that have been submitted but not yet finished.
+// A thread can wait on a counter to know when a batch of work is complete.
+class JobCounter {
+public:
+    std::atomic<int> pending = 0; // Number of outstanding jobs
+
+    // Returns true once every job attached to the counter has finished
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// A unit of work that can depend on other tasks.
+// A task is queued only after every task that precedes it has finished,
+// which lets a frame be described as a small graph of stages.
+class Task {
+public:
+    static const int maxSuccessors = 8;
+
+    std::function<void()> work;          // Work performed by the task
+    std::atomic<int> dependencies = 1;   // Unfinished predecessors, plus one until the task is run
+    Task* successors[maxSuccessors];     // Tasks waiting for this one to finish
+    int numSuccessors = 0;
+    JobCounter* counter = nullptr;       // Counter signalled when the task finishes
+
+    // Prepares the task for reuse with new work and no dependencies
+    // Input Variables:
+    // - _work: Function executed by the task
+    void reset(std::function<void()> _work) {
+        work = std::move(_work);
+        dependencies.store(1, std::memory_order_relaxed);
+        numSuccessors = 0;
+        counter = nullptr;
+    }
+
+    // Makes another task wait until this one has finished
+    // Must be called before either task is run, at most maxSuccessors times per task
+    // Input Variables:
+    // - next: Task that depends on this one
+    void precede(Task& next) {
+        if (numSuccessors >= maxSuccessors)
+            throw std::length_error("A task can precede at most Task::maxSuccessors tasks");
+        successors[numSuccessors++] = &next;
+        next.dependencies.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Persistent pool of worker threads with a work-stealing deque per thread.
+// Workers are created once, sized from the hardware, and sleep when there is no work.
+// The thread that submits work (the render thread) owns deque 0 and helps execute
+// jobs while it waits, so a pool with N workers runs N + 1 jobs at a time.
+class ThreadPool {
+    // A range of work for a job function, with the counter to signal when done
+    struct Job {
+        void (*function)(void* data, size_t begin, size_t end);
+        void* data;
+        size_t begin, end;
+        JobCounter* counter;
+    };
+
+    // Fixed-size double-ended queue of jobs.
+    // The owning thread pushes and pops at the back (most recent work, still in cache)
+    // while other threads steal from the front (oldest, usually largest, work).
+    class JobQueue {
+        static const size_t capacity = 4096;
+
+        std::mutex lock;
+        Job jobs[capacity];
+        size_t head = 0, tail = 0; // Jobs live in [head, tail), indices wrap around
+
+    public:
+        bool push(const Job& job) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (tail - head == capacity) return false;
+            jobs[tail++ % capacity] = job;
+            return true;
+        }
+
+        bool pop(Job& job) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (tail == head) return false;
+            job = jobs[--tail % capacity];
+            return true;
+        }
+
+        bool steal(Job& job) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (tail == head) return false;
+            job = jobs[head++ % capacity];
+            return true;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<JobQueue> queues;              // One queue per thread, index 0 is the submitting thread
+    std::atomic<int> queued = 0;              // Jobs currently sitting in any queue
+    std::atomic<int> sleeping = 0;            // Workers blocked on the condition variable
+    std::atomic<bool> running = true;
+    std::mutex sleepLock;
+    std::condition_variable wake;
+
+    // Index of the queue owned by the calling thread (0 for threads outside the pool)
+    static unsigned int& localIndex() {
+        static thread_local unsigned int index = 0;
+        return index;
+    }
+
+    ThreadPool() {
+        unsigned int hardware = std::thread::hardware_concurrency();
+        unsigned int numWorkers = hardware > 1 ? hardware - 1 : 0;
+
+        for (unsigned int i = 0; i <= numWorkers; i++)
+            queues.emplace_back();
+        for (unsigned int i = 1; i <= numWorkers; i++)
+            workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            running = false;
+        }
+        wake.notify_all();
+        for (auto& w : workers)
+            w.join();
+    }
+
+    // Main loop of a worker: run jobs while any exist, otherwise sleep
+    void workerLoop(unsigned int index) {
+        localIndex() = index;
+        Profiler::getInstance().setThreadName("worker " + std::to_string(index));
+        while (running) {
+            Job job;
+            if (findJob(job)) {
+                execute(job);
+                continue;
+            }
+
+            // Spin briefly before sleeping, work usually arrives in bursts every frame
+            bool found = false;
+            for (int spin = 0; spin < 64 && !found; spin++) {
+                std::this_thread::yield();
+                found = queued.load() > 0;
+            }
+            if (found) continue;
+
+            PROFILE_SCOPE("sleep");
+            std::unique_lock<std::mutex> guard(sleepLock);
+            sleeping++;
+            wake.wait(guard, [this]() { return queued.load() > 0 || !running; });
+            sleeping--;
+        }
+    }
+
+    // Takes a job from the local queue, or steals one from another thread
+    bool findJob(Job& job) {
+        unsigned int self = localIndex();
+        if (queues[self].pop(job)) {
+            queued--;
+            return true;
+        }
+        for (size_t i = 1; i < queues.size(); i++) {
+            if (queues[(self + i) % queues.size()].steal(job)) {
+                queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(const Job& job) {
+        job.function(job.data, job.begin, job.end);
+        job.counter->pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    // Queues a job on the calling thread's deque and wakes a sleeping worker
+    void push(const Job& job) {
+        job.counter->pending.fetch_add(1, std::memory_order_relaxed);
+        if (!queues[localIndex()].push(job)) {
+            execute(job); // Queue is full, run the job inline
+            return;
+        }
+        queued++;
+        if (sleeping.load() > 0) {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            wake.notify_all();
+        }
+    }
+
+    // Releases one dependency of a task and queues it once all are satisfied
+    void release(Task& task) {
+        if (task.dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            push(Job{ &ThreadPool::runTask, &task, 0, 0, task.counter });
+    }
+
+    static void runTask(void* data, size_t, size_t) {
+        Task& task = *static_cast<Task*>(data);
+        task.work();
+        ThreadPool& pool = getInstance();
+        for (int i = 0; i < task.numSuccessors; i++)
+            pool.release(*task.successors[i]);
+        task.counter->pending.fetch_sub(1, std::memory_order_release); // Matches the increment in run()
+    }
+
+public:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Get the shared pool, created on first use
+    static ThreadPool& getInstance() {
+        static ThreadPool instance;
+        return instance;
+    }
+
+    // Number of threads that execute jobs, including the submitting thread
+    unsigned int threadCount() const { return static_cast<unsigned int>(queues.size()); }
+
+    // Index of the calling thread in [0, threadCount()), 0 for the submitting thread
+    static unsigned int workerIndex() { return localIndex(); }
+
+    // Submits a task. It is queued straight away if it has no unfinished predecessors,
+    // otherwise the last predecessor to finish queues it.
+    // Input Variables:
+    // - task: Task to run, must stay alive until the counter reports completion
+    // - counter: Counter signalled when the task finishes
+    void run(Task& task, JobCounter& counter) {
+        task.counter = &counter;
+        counter.pending.fetch_add(1, std::memory_order_relaxed); // Held until the task has finished
+        release(task);
+    }
+
+    // Blocks until all jobs attached to a counter have finished.
+    // The waiting thread executes queued jobs instead of idling.
+    // Input Variables:
+    // - counter: Counter to wait for
+    void wait(JobCounter& counter) {
+        PROFILE_SCOPE("wait");
+        while (!counter.done()) {
+            Job job;
+            if (findJob(job))
+                execute(job);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    // Runs f(first, last) over sub-ranges of [begin, end) on all threads and waits for them.
+    // Input Variables:
+    // - begin, end: Range of indices to process
+    // - grain: Maximum number of indices handed to a single job
+    // - f: Function called with each sub-range [first, last)
+    template <typename F>
+    void parallelFor(size_t begin, size_t end, size_t grain, F&& f) {
+        if (begin >= end) return;
+        if (grain == 0) grain = 1;
+
+        auto call = [](void* data, size_t first, size_t last) {
+            (*static_cast<std::remove_reference_t<F>*>(data))(first, last);
+        };
+
+        JobCounter counter;
+        for (size_t first = begin; first < end; first += grain) {
+            size_t last = (end - first > grain) ? first + grain : end;
+            push(Job{ call, (void*)&f, first, last, &counter });
+        }
+        wait(counter);
+    }
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vector>
+#include "frameArena.h"
+#include "platform.h"
+
+// Screen-space tile grid used by the multithreaded renderer.
+// Triangles are sorted into every tile their bounding box touches, so each tile
+// can later be rasterized by a single thread without locking the canvas or Z-buffer.
+class TileBins {
+    unsigned int width = 0, height = 0; // Dimensions of the screen being binned
+
+public:
+    static const int tileSize = 64;     // Width and height of a tile in pixels
+
+    int tilesX = 0, tilesY = 0;         // Number of tiles across and down the screen
+
+    // bins[thread][tile] lists the triangles produced by that thread as sort entries
+    // (see makeSortEntry): a depth key above the triangle's index in the thread's list.
+    // Every thread writes only to its own row, so binning needs no synchronisation.
+    // The lists live in the frame arena of the thread that fills them.
+    std::vector<std::vector<ArenaArray<unsigned long long>>> bins;
+
+    // binSizes[thread][tile] counts the triangles reserved in each bin before they are added
+    std::vector<std::vector<unsigned int>> binSizes;
+
+    // Sets up the tile grid for a screen and number of producer threads
+    // Input Variables:
+    // - w, h: Screen dimensions in pixels
+    // - threads: Number of threads that will add triangles
+    void resize(unsigned int w, unsigned int h, unsigned int threads) {
+        width = w;
+        height = h;
+        tilesX = (w + tileSize - 1) / tileSize;
+        tilesY = (h + tileSize - 1) / tileSize;
+
+        bins.resize(threads);
+        for (auto& threadBins : bins)
+            threadBins.resize(tilesX * tilesY);
+        binSizes.resize(threads);
+        for (auto& sizes : binSizes)
+            sizes.resize(tilesX * tilesY);
+    }
+
+    // Total number of tiles in the grid
+    int count() const { return tilesX * tilesY; }
+
+    // Empties all bins owned by a thread, dropping the storage of the last frame
+    // Input Variables:
+    // - thread: Index of the producer thread
+    void clear(unsigned int thread) {
+        for (auto& bin : bins[thread])
+            bin.reset();
+    }
+
+    // Finds the tiles overlapped by a screen-space bounding box
+    // Input Variables:
+    // - x0, y0, x1, y1: Pixels the triangle can cover, x1 and y1 exclusive
+    // Output Variables:
+    // - tx0, ty0, tx1, ty1: First and last tile along each axis (inclusive)
+    // Returns false if the box lies completely off screen
+    bool getTileRange(int x0, int y0, int x1, int y1, int& tx0, int& ty0, int& tx1, int& ty1) const {
+        if (x1 <= 0 || y1 <= 0 || x0 >= (int)width || y0 >= (int)height) return false;
+
+        tx0 = max(x0, 0) / tileSize;
+        ty0 = max(y0, 0) / tileSize;
+        tx1 = (min(x1, (int)width) - 1) / tileSize;
+        ty1 = (min(y1, (int)height) - 1) / tileSize;
+        return true;
+    }
+
+    // Counts a triangle in every tile it will be added to. Counting every triangle of a thread
+    // before allocate lets each bin take its storage in one piece rather than growing.
+    // Input Variables:
+    // - thread: Index of the producer thread
+    // - x0, y0, x1, y1: Pixels the triangle can cover, x1 and y1 exclusive
+    void reserve(unsigned int thread, int x0, int y0, int x1, int y1) {
+        int tx0, ty0, tx1, ty1;
+        if (!getTileRange(x0, y0, x1, y1, tx0, ty0, tx1, ty1)) return;
+
+        std::vector<unsigned int>& sizes = binSizes[thread];
+        for (int ty = ty0; ty <= ty1; ty++)
+            for (int tx = tx0; tx <= tx1; tx++)
+                sizes[ty * tilesX + tx]++;
+    }
+
+    // Allocates the bins of a thread for the triangles counted by reserve
+    // Input Variables:
+    // - thread: Index of the producer thread
+    void allocate(unsigned int thread) {
+        std::vector<unsigned int>& sizes = binSizes[thread];
+        for (size_t tile = 0; tile < sizes.size(); tile++) {
+            bins[thread][tile].reserve(sizes[tile]);
+            sizes[tile] = 0;
+        }
+    }
+
+    // Adds a triangle to every tile overlapped by its screen-space bounding box
+    // Input Variables:
+    // - thread: Index of the producer thread
+    // - entry: Sort entry of the triangle, its index in that thread's triangle list under a key
+    // - x0, y0, x1, y1: Pixels the triangle can cover, x1 and y1 exclusive
+    void add(unsigned int thread, unsigned long long entry, int x0, int y0, int x1, int y1) {
+        int tx0, ty0, tx1, ty1;
+        if (!getTileRange(x0, y0, x1, y1, tx0, ty0, tx1, ty1)) return;
+
+        std::vector<ArenaArray<unsigned long long>>& threadBins = bins[thread];
+        for (int ty = ty0; ty <= ty1; ty++)
+            for (int tx = tx0; tx <= tx1; tx++)
+                threadBins[ty * tilesX + tx].push_back(entry);
+    }
+
+    // Returns the pixel rectangle covered by a tile, clipped to the screen
+    // Input Variables:
+    // - tile: Index of the tile
+    // Output Variables:
+    // - x0, y0: Top-left pixel of the tile (inclusive)
+    // - x1, y1: Bottom-right pixel of the tile (exclusive)
+    void getTileRect(int tile, int& x0, int& y0, int& x1, int& y1) const {
+        x0 = (tile % tilesX) * tileSize;
+        y0 = (tile / tilesX) * tileSize;
+        x1 = min(x0 + tileSize, (int)width);
+        y1 = min(y0 + tileSize, (int)height);
+    }
+};
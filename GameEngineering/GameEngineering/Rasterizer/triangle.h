@@ -4,6 +4,10 @@
 #include "colour.h"
 #include "renderer.h"
 #include "light.h"
+#include "simd.h"
+#include "stats.h"
+#include <bit>
+#include <cfloat>
 #include <iostream>
 
 // Simple support class for a 2D vector
@@ -35,52 +39,179 @@ public:
     }
 };
 
-// Class representing a triangle for rendering purposes
-class triangle {
-    Vertex v[3];       // Vertices of the triangle
-    float area;        // Area of the triangle
-    colour col[3];     // Colors for each vertex of the triangle
+// How a raster pass treats the Z-buffer
+enum class DepthPass {
+    Write,   // Draw the pixels nearer than the Z-buffer and store their depth
+    Prepass, // Store depth only, ahead of a shading pass, without counting statistics
+    Equal    // Shade the pixels whose depth matches the prepass, leaving the Z-buffer as it is
+};
 
-public:
-    // Constructor initializes the triangle with three vertices
+// Raster setup of a screen-space triangle: everything binning and the raster loops read for
+// every triangle, in one cache line. The colours, normals and material the pixels are shaded
+// with are kept apart in TriAttributes and only read for pixels that pass the depth test.
+//
+// Vertices are snapped to 1 / subPixelScale of a pixel, so edge i (the edge opposite vertex i)
+// at the centre of pixel (x, y) is exactly stepX_i * x + stepY_i * y + setup.edgeOrigin[i], in
+// 1 / subPixelScale^2 pixel units, with the steps following from the snapped vertices (see
+// triangle). Edges that are neither top nor left edges are biased by -1, so that a pixel is
+// covered when all three are >= 0 and a pixel centre on an edge shared by two triangles
+// belongs to one of them.
+struct alignas(64) TriSetup {
+    static const int subPixelBits = 4;                    // Vertices are snapped to 1 / 2^subPixelBits of a pixel
+    static const int subPixelScale = 1 << subPixelBits;   // Sub-pixel positions per pixel along each axis
+
+    long long edgeOrigin[3]; // Fixed-point edges at the centre of pixel (0, 0), including the bias
+    int sx[3], sy[3];        // Snapped vertex positions, in sub-pixels
+    float z[3];              // Vertex depths
+    float area;              // Signed area of the triangle (twice the geometric area), negative if it faces away
+
+    TriSetup() = default;
+
+    // Snaps the vertices to the sub-pixel grid and sets up the fixed-point edges
     // Input Variables:
-    // - v1, v2, v3: Vertices defining the triangle
-    triangle(const Vertex& v1, const Vertex& v2, const Vertex& v3) {
-        v[0] = v1;
-        v[1] = v2;
-        v[2] = v3;
+    // - v0, v1, v2: Screen-space vertices, with depth in z
+    TriSetup(const Vertex& v0, const Vertex& v1, const Vertex& v2) {
+        // Snap the vertices to the sub-pixel grid (rounding to nearest), triangles sharing an edge
+        // snap it identically. The guard band keeps the positions, and the edge coefficients
+        // below, well within 32 bits; only the products need 64.
+        alignas(16) int x[4], y[4];
+        const __m128 scale = _mm_set1_ps((float)subPixelScale);
+        _mm_store_si128((__m128i*)x, _mm_cvtps_epi32(_mm_mul_ps(_mm_setr_ps(v0.p[0], v1.p[0], v2.p[0], 0.f), scale)));
+        _mm_store_si128((__m128i*)y, _mm_cvtps_epi32(_mm_mul_ps(_mm_setr_ps(v0.p[1], v1.p[1], v2.p[1], 0.f), scale)));
+
+        // Calculate the signed 2D area of the triangle.
+        // Triangles wound the other way have negative area and are never drawn.
+        long long area2 = (long long)(x[1] - x[0]) * (y[2] - y[0]) - (long long)(y[1] - y[0]) * (x[2] - x[0]);
+        area = (float)area2 / (subPixelScale * subPixelScale);
+
+        for (unsigned int i = 0; i < 3; i++) {
+            sx[i] = x[i];
+            sy[i] = y[i];
+            unsigned int a = i == 2 ? 0 : i + 1, b = i == 0 ? 2 : i - 1;
+            int A = y[a] - y[b];
+            int B = x[b] - x[a];
+            edgeOrigin[i] = edgeConstant(A, B, x[a], y[a]) - (isTopLeft(A, B) ? 0 : 1);
+        }
+        z[0] = v0.p[2];
+        z[1] = v1.p[2];
+        z[2] = v2.p[2];
+    }
+
+    // Constant of the edge through a vertex with coefficients A and B, sampled at the pixel centre
+    static long long edgeConstant(int A, int B, int x, int y) {
+        return (long long)(A + B) * (subPixelScale / 2) - ((long long)A * x + (long long)B * y);
+    }
 
-        // Calculate the 2D area of the triangle
-        vec2D e1 = vec2D(v[1].p - v[0].p);
-        vec2D e2 = vec2D(v[2].p - v[0].p);
-        area = abs(e1.x * e2.y - e1.y * e2.x);
+    // Top edges are horizontal with the triangle below them, left edges have it to their right.
+    // Pixel centres exactly on any other edge are left to the neighbouring triangle.
+    static bool isTopLeft(int A, int B) { return A > 0 || (A == 0 && B > 0); }
+
+    // Nearest depth of the vertices
+    float getMinDepth() const { return min(z[0], min(z[1], z[2])); }
+
+    // Farthest depth of the vertices
+    float getMaxDepth() const { return max(z[0], max(z[1], z[2])); }
+
+    // Compute the pixels whose centres the triangle can cover, from the snapped vertices
+    // Output Variables:
+    // - x0, y0: First pixel along each axis (inclusive)
+    // - x1, y1: Last pixel along each axis (exclusive), no larger than x0, y0 if there is none
+    void getSampleBounds(int& x0, int& y0, int& x1, int& y1) const {
+        // Pixel x has its centre at x * subPixelScale + subPixelScale / 2, the shifts round down
+        const int half = subPixelScale / 2;
+        x0 = (min(sx[0], min(sx[1], sx[2])) + half - 1) >> subPixelBits;
+        y0 = (min(sy[0], min(sy[1], sy[2])) + half - 1) >> subPixelBits;
+        x1 = ((max(sx[0], max(sx[1], sx[2])) - half) >> subPixelBits) + 1;
+        y1 = ((max(sy[0], max(sy[1], sy[2])) - half) >> subPixelBits) + 1;
     }
+};
+
+static_assert(sizeof(TriSetup) == 64, "TriSetup is meant to fill one cache line");
+
+// Shading inputs of a triangle, read by the pixel kernels only for the pixels they shade.
+// Kept as vertex values interpolated with the barycentric weights the kernels compute anyway.
+struct TriAttributes {
+    vec4 normal[3];    // Vertex normals, first as vec4 is aligned to 16 bytes
+    colour rgb[3];     // Vertex colours
+    float ka, kd;      // Ambient and diffuse coefficients of the mesh or instance the triangle belongs to
+
+    TriAttributes() = default;
 
-    // Helper function to compute the cross product for barycentric coordinates
     // Input Variables:
-    // - v1, v2: Edges defining the vector
-    // - p: Point for which coordinates are being calculated
-    float getC(vec2D v1, vec2D v2, vec2D p) {
-        vec2D e = v2 - v1;
-        vec2D q = p - v1;
-        return q.y * e.x - q.x * e.y;
+    // - v0, v1, v2: Vertices of the triangle, in the order given to its TriSetup
+    // - _ka, _kd: Material coefficients, the defaults match those of a new Mesh
+    TriAttributes(const Vertex& v0, const Vertex& v1, const Vertex& v2, float _ka = 0.75f, float _kd = 0.75f) : ka(_ka), kd(_kd) {
+        rgb[0] = v0.rgb;
+        rgb[1] = v1.rgb;
+        rgb[2] = v2.rgb;
+        normal[0] = v0.normal;
+        normal[1] = v1.normal;
+        normal[2] = v2.normal;
     }
+};
+
+// A triangle being drawn: its setup and attributes, plus what the raster loops derive from
+// them for the draw, such as the float edge equations and the depth plane
+class triangle {
+    const TriSetup& setup;             // Coverage and depth
+    const TriAttributes& attributes;   // Colours, normals and material
+
+    // Edge equations E(x, y) = A * x + B * y + C, one per edge, evaluated at the centre of pixel (x, y).
+    // Edge i is the edge opposite vertex i, so E_i / area is the barycentric weight of vertex i.
+    float edgeA[3], edgeB[3], edgeC[3];
+    float invArea;     // 1 / area, computed once so the pixel loop only multiplies
+
+    // Steps of the fixed-point edges of the setup, one pixel right and one pixel down
+    int edgeStepX[3], edgeStepY[3];
+    static constexpr long long edgeClamp = 1ll << 30; // Bound on the fixed-point edge values handed to the pixel kernels
 
-    // Compute barycentric coordinates for a given point
+    // Depth as a plane over the screen, depth(x, y) = depthA * x + depthB * y + depthC
+    float depthA, depthB, depthC;
+    float minDepth;    // Nearest depth of the three vertices
+    float maxDepth;    // Farthest depth of the three vertices
+
+public:
+    // Size of the pixel blocks tested against the edges before visiting single pixels
+    static const int blockSize = 8;
+
+    // Sub-pixel positions per pixel along each axis that vertices are snapped to
+    static const int subPixelScale = TriSetup::subPixelScale;
+
+    // Sets up the edge equations and depth plane of a triangle for drawing
     // Input Variables:
-    // - p: Point to check within the triangle
-    // Output Variables:
-    // - alpha, beta, gamma: Barycentric coordinates of the point
-    // Returns true if the point is inside the triangle, false otherwise
-    bool getCoordinates(vec2D p, float& alpha, float& beta, float& gamma) {
-        alpha = getC(vec2D(v[0].p), vec2D(v[1].p), p) / area;
-        beta = getC(vec2D(v[1].p), vec2D(v[2].p), p) / area;
-        gamma = getC(vec2D(v[2].p), vec2D(v[0].p), p) / area;
+    // - _setup: Raster setup of the triangle
+    // - _attributes: Shading inputs of the triangle
+    // Both must outlive the triangle
+    triangle(const TriSetup& _setup, const TriAttributes& _attributes) : setup(_setup), attributes(_attributes) {
+        const float unit = 1.f / (subPixelScale * subPixelScale);
+        invArea = 1.f / setup.area;
+
+        for (unsigned int i = 0; i < 3; i++) {
+            unsigned int a = i == 2 ? 0 : i + 1, b = i == 0 ? 2 : i - 1;
+            int A = setup.sy[a] - setup.sy[b];
+            int B = setup.sx[b] - setup.sx[a];
+            edgeStepX[i] = A * subPixelScale;
+            edgeStepY[i] = B * subPixelScale;
 
-        if (alpha < 0.f || beta < 0.f || gamma < 0.f) return false;
-        return true;
+            // The float equations take the edges without the top-left bias
+            edgeA[i] = (float)edgeStepX[i] * unit;
+            edgeB[i] = (float)edgeStepY[i] * unit;
+            edgeC[i] = (float)(setup.edgeOrigin[i] + (TriSetup::isTopLeft(A, B) ? 0 : 1)) * unit;
+        }
+
+        depthA = (edgeA[0] * setup.z[0] + edgeA[1] * setup.z[1] + edgeA[2] * setup.z[2]) * invArea;
+        depthB = (edgeB[0] * setup.z[0] + edgeB[1] * setup.z[1] + edgeB[2] * setup.z[2]) * invArea;
+        depthC = (edgeC[0] * setup.z[0] + edgeC[1] * setup.z[1] + edgeC[2] * setup.z[2]) * invArea;
+        minDepth = setup.getMinDepth();
+        maxDepth = setup.getMaxDepth();
     }
 
+    // Signed area of the triangle on screen (twice the geometric area), negative if it faces away
+    float getArea() const { return setup.area; }
+
+    // Nearest depth of the triangle's vertices
+    float getMinDepth() const { return minDepth; }
+
     // Template function to interpolate values using barycentric coordinates
     // Input Variables:
     // - alpha, beta, gamma: Barycentric coordinates
@@ -95,59 +226,866 @@ public:
     // Input Variables:
     // - renderer: Renderer object for drawing
     // - L: Light object for shading calculations
-    // - ka, kd: Ambient and diffuse lighting coefficients
-    void draw(Renderer& renderer, Light& L, float ka, float kd) {
-        vec2D minV, maxV;
+    // - kd: Diffuse lighting coefficient, which also scales the ambient light
+    // Returns the number of pixels written
+    int draw(Renderer& renderer, Light& L, float kd) {
+        return draw(renderer, L, kd, 0, 0, renderer.canvas.getWidth(), renderer.canvas.getHeight());
+    }
 
-        // Get the screen-space bounds of the triangle
-        getBoundsWindow(renderer.canvas, minV, maxV);
+    // Draw the part of the triangle that lies inside a screen rectangle
+    // Used by the tiled renderer so that threads only touch pixels of their own tile
+    // The rectangle is walked in 8x8 blocks: blocks outside an edge are skipped,
+    // blocks inside all edges are filled without per-pixel tests, and the edge
+    // values are stepped incrementally along rows and columns.
+    // Blocks and triangles whose nearest depth is behind the farthest depth already in the
+    // Z-buffer's coarse tiles are rejected before any interpolation.
+    // Input Variables:
+    // - renderer: Renderer object for drawing
+    // - L: Light object for shading calculations
+    // - kd: Diffuse lighting coefficient, which also scales the ambient light
+    // - x0, y0: Top-left pixel of the rectangle (inclusive)
+    // - x1, y1: Bottom-right pixel of the rectangle (exclusive)
+    // - afterPrepass: True if drawDepth already stored the final depths, only the pixels
+    //   matching them are then shaded and the Z-buffer is left as it is
+    // Returns the number of pixels written
+    // Pixels tested and written are also added to the calling thread's localStats
+    int draw(Renderer& renderer, Light& L, float kd, int x0, int y0, int x1, int y1, bool afterPrepass = false) {
+        // The light direction is the same for every pixel
+        L.omega_i.normalise();
 
-        // Skip very small triangles
-        if (area < 1.f) return;
+        if (afterPrepass)
+            return shade<DepthPass::Equal>(renderer, L, kd, x0, y0, x1, y1);
+        return shade<DepthPass::Write>(renderer, L, kd, x0, y0, x1, y1);
+    }
 
-        // Iterate over the bounding box and check each pixel
-        for (int y = (int)(minV.y); y < (int)ceil(maxV.y); y++) {
-            for (int x = (int)(minV.x); x < (int)ceil(maxV.x); x++) {
-                float alpha, beta, gamma;
+    // Depth-only counterpart of draw for a prepass: stores the depth of the pixels that pass
+    // the depth test and nothing else, so a later draw with afterPrepass set shades every
+    // pixel once. Not counted in localStats.
+    // Input Variables:
+    // - renderer: Renderer object holding the Z-buffer
+    // - x0, y0: Top-left pixel of the rectangle (inclusive)
+    // - x1, y1: Bottom-right pixel of the rectangle (exclusive)
+    // Returns the number of depths written
+    int drawDepth(Renderer& renderer, int x0, int y0, int x1, int y1) {
+        SimdLevel level = simdLevel();
+        return rasterize<DepthPass::Prepass>(renderer, x0, y0, x1, y1, [&](int x, int y, int count, const float* w, const int* e, bool inside, int& tested) {
+            switch (level) {
+            case SimdLevel::AVX2: return depthRowAVX2<false>(renderer, 0, x, y, count, w, e, inside, tested);
+            case SimdLevel::SSE41: return depthRowSSE41<false>(renderer, 0, x, y, count, w, e, inside, tested);
+            default: return depthRowScalar<false>(renderer, 0, x, y, count, w, e, inside, tested);
+            }
+        });
+    }
 
-                // Check if the pixel lies inside the triangle
-                if (getCoordinates(vec2D((float)x, (float)y), alpha, beta, gamma)) {
-                    // Interpolate color, depth, and normals
-                    colour c = interpolate(beta, gamma, alpha, v[0].rgb, v[1].rgb, v[2].rgb);
+    // Visibility-buffer counterpart of draw: only depth and the triangle's ID are stored for
+    // the pixels that pass the depth test, shading is left to resolveRun in a later pass
+    // Input Variables:
+    // - renderer: Renderer object holding the Z-buffer and visibility buffer
+    // - id: Value stored for the pixels the triangle covers
+    // - x0, y0: Top-left pixel of the rectangle (inclusive)
+    // - x1, y1: Bottom-right pixel of the rectangle (exclusive)
+    // Returns the number of pixels written
+    int drawVisibility(Renderer& renderer, unsigned int id, int x0, int y0, int x1, int y1) {
+        SimdLevel level = simdLevel();
+        return rasterize<DepthPass::Write>(renderer, x0, y0, x1, y1, [&](int x, int y, int count, const float* w, const int* e, bool inside, int& tested) {
+            switch (level) {
+            case SimdLevel::AVX2: return depthRowAVX2<true>(renderer, id, x, y, count, w, e, inside, tested);
+            case SimdLevel::SSE41: return depthRowSSE41<true>(renderer, id, x, y, count, w, e, inside, tested);
+            default: return depthRowScalar<true>(renderer, id, x, y, count, w, e, inside, tested);
+            }
+        });
+    }
+
+private:
+    // Bound on how far the depth interpolated at a pixel can stray from the exact depth plane.
+    // Edge values are evaluated at each block's first pixel and then stepped, so both the
+    // evaluation and up to 2 * blockSize steps round; the depth sums the three edge values
+    // weighted by the vertex depths.
+    // Input Variables:
+    // - x, y: Largest pixel coordinates the triangle is drawn at
+    // Returns the bound on the absolute depth error
+    float depthError(int x, int y) const {
+        float error = 0.f;
+        for (unsigned int i = 0; i < 3; i++) {
+            float edge = fabsf(edgeA[i]) * x + fabsf(edgeB[i]) * y + fabsf(edgeC[i]) + 2 * blockSize * (fabsf(edgeA[i]) + fabsf(edgeB[i]));
+            error += fabsf(setup.z[i]) * edge;
+        }
+        return 4.f * FLT_EPSILON * error * invArea + 4.f * FLT_EPSILON;
+    }
+
+    // Shading pass of draw, with the pixel kernel chosen from the instruction sets this CPU supports
+    template <DepthPass Pass>
+    int shade(Renderer& renderer, Light& L, float kd, int x0, int y0, int x1, int y1) {
+        const bool equal = Pass == DepthPass::Equal;
+        SimdLevel level = simdLevel();
+        return rasterize<Pass>(renderer, x0, y0, x1, y1, [&](int x, int y, int count, const float* w, const int* e, bool inside, int& tested) {
+            switch (level) {
+            case SimdLevel::AVX2: return shadeRowAVX2<equal>(renderer, L, kd, x, y, count, w, e, inside, tested);
+            case SimdLevel::SSE41: return shadeRowSSE41<equal>(renderer, L, kd, x, y, count, w, e, inside, tested);
+            default: return shadeRowScalar<equal>(renderer, L, kd, x, y, count, w, e, inside, tested);
+            }
+        });
+    }
+
+    // Walks the part of the triangle inside a screen rectangle block by block, see draw,
+    // handing each row of a surviving block to a pixel kernel
+    // Input Variables:
+    // - renderer: Renderer object for drawing
+    // - x0, y0, x1, y1: Screen rectangle, as for draw
+    // - row: Kernel called as row(x, y, count, w, e, inside, tested), returning the pixels it wrote
+    // Returns the number of pixels written
+    template <DepthPass Pass, typename Row>
+    int rasterize(Renderer& renderer, int x0, int y0, int x1, int y1, Row&& row) {
+        // Skip back-facing and degenerate triangles
+        if (setup.area <= 0.f) return 0;
+
+        // Restrict the pixels whose centres the triangle can cover to the requested rectangle
+        int sampleX0, sampleY0, sampleX1, sampleY1;
+        getSampleBounds(sampleX0, sampleY0, sampleX1, sampleY1);
+        int startX = max(sampleX0, x0);
+        int startY = max(sampleY0, y0);
+        int endX = min(sampleX1, x1);
+        int endY = min(sampleY1, y1);
+        if (startX >= endX || startY >= endY) return 0;
+
+        // Skip the whole triangle if it is behind everything already drawn in its area.
+        // After a prepass the visible surfaces sit exactly at the stored depths, so only
+        // triangles behind them by more than the rounding of the interpolated depth are skipped.
+        const bool equal = Pass == DepthPass::Equal;
+        float slack = equal ? depthError(endX, endY) : 0.f;
+        float farthest = renderer.zbuffer.maxDepth(startX, startY, endX, endY);
+        if (equal ? minDepth > farthest + slack : minDepth >= farthest) return 0;
+
+        // Only triangles that are small as a whole take the quad path, not large ones that just
+        // clip to a few pixels of the rectangle: their edge values need more than 32 bits
+        if (sampleX1 - sampleX0 <= 2 && sampleY1 - sampleY0 <= 2)
+            return rasterizeQuad<Pass>(renderer, startX, startY, endX, endY, row);
+
+        int drawn = 0, tested = 0;
+
+        // Walk the bounding box in blocks aligned to the screen grid
+        for (int by = startY & ~(blockSize - 1); by < endY; by += blockSize) {
+            int blockY0 = max(by, startY);
+            int blockY1 = min(by + blockSize, endY);
+
+            for (int bx = startX & ~(blockSize - 1); bx < endX; bx += blockSize) {
+                int blockX0 = max(bx, startX);
+                int blockX1 = min(bx + blockSize, endX);
+
+                // Fixed-point edge values at the first pixel of the block. As the edges are linear,
+                // their extremes over the block are found at its corners. The values passed on are
+                // clamped to 32 bits: they change by far less than the clamp within a block, so
+                // no pixel changes side.
+                float w[3];
+                int e[3];
+                bool empty = false, inside = true;
+                for (unsigned int i = 0; i < 3; i++) {
+                    long long e0 = (long long)edgeStepX[i] * blockX0 + (long long)edgeStepY[i] * blockY0 + setup.edgeOrigin[i];
+                    long long dx = (long long)edgeStepX[i] * (blockX1 - 1 - blockX0);
+                    long long dy = (long long)edgeStepY[i] * (blockY1 - 1 - blockY0);
+                    if (e0 + max(dx, 0ll) + max(dy, 0ll) < 0) empty = true;
+                    if (e0 + min(dx, 0ll) + min(dy, 0ll) < 0) inside = false;
+                    e[i] = (int)max(min(e0, edgeClamp), -edgeClamp);
+                    w[i] = edgeA[i] * blockX0 + edgeB[i] * blockY0 + edgeC[i];
+                }
+                if (empty) continue;
+
+                // Nearest depth the triangle can have in this block, from the depth plane at
+                // the block corners. Blocks are aligned with the Z-buffer's coarse tiles.
+                float dx = depthA * (blockX1 - 1 - blockX0);
+                float dy = depthB * (blockY1 - 1 - blockY0);
+                float blockDepth = depthA * blockX0 + depthB * blockY0 + depthC + min(dx, 0.f) + min(dy, 0.f);
+                float blockFar = depthA * blockX0 + depthB * blockY0 + depthC + max(dx, 0.f) + max(dy, 0.f);
+                unsigned int tx = bx / blockSize, ty = by / blockSize;
+                float tileDepth = renderer.zbuffer.tileDepth(tx, ty) + slack;
+                if (equal ? max(blockDepth, minDepth) > tileDepth : max(blockDepth, minDepth) >= tileDepth) continue;
+
+                // With the lazy clear, the first block of the frame to reach a tile clears it
+                renderer.zbuffer.prepareTile(tx, ty);
+
+                int written = 0;
+                for (int y = blockY0; y < blockY1; y++) {
+                    written += row(blockX0, y, blockX1 - blockX0, w, e, inside, tested);
+
+                    // Step the edge values one row down
+                    for (unsigned int i = 0; i < 3; i++) {
+                        w[i] += edgeB[i];
+                        e[i] += edgeStepY[i];
+                    }
+                }
+
+                // Keep the coarse tile conservative after new depths were stored. When the
+                // triangle covers the whole tile every pixel now holds a depth no farther than
+                // the triangle's own farthest depth there, so no pixels need to be read back.
+                // A pass after the prepass stores no depths and leaves the tiles alone.
+                drawn += written;
+                if (written && !equal) {
+                    bool wholeTile = inside && blockX0 == bx && blockY0 == by &&
+                        blockX1 == min(bx + blockSize, (int)renderer.canvas.getWidth()) &&
+                        blockY1 == min(by + blockSize, (int)renderer.canvas.getHeight());
+                    if (wholeTile && minDepth > 0.01f)
+                        renderer.zbuffer.coverTile(tx, ty, min(blockFar, maxDepth));
+                    else
+                        renderer.zbuffer.updateTile(tx, ty);
+                }
+            }
+        }
+
+        if (Pass != DepthPass::Prepass) {
+            RenderStats& stats = localStats();
+            stats.pixelsTested += tested;
+            stats.pixels += drawn;
+        }
+        return drawn;
+    }
+
+    // Small-triangle path of rasterize, for triangles whose pixel centres fit in a 2x2 quad.
+    // Such triangles, mostly distant tessellated geometry, cover zero to a few pixels: one test
+    // of the quad's centres against the edges decides coverage, and only rows with a covered
+    // pixel reach the kernel. There is no block walk, and the coarse tiles are left as they are,
+    // since storing nearer depths keeps their farthest depth conservative.
+    // Input Variables:
+    // - renderer: Renderer object for drawing
+    // - x0, y0, x1, y1: Pixels the triangle can cover within the rectangle being drawn; the
+    //   triangle's own sample bounds must be at most 2 x 2
+    // - row: Pixel kernel, as for rasterize
+    // Returns the number of pixels written
+    template <DepthPass Pass, typename Row>
+    int rasterizeQuad(Renderer& renderer, int x0, int y0, int x1, int y1, Row&& row) {
+        // Fixed-point edge values at the first pixel of each row. All of the triangle's pixel
+        // centres fit in the quad, so its snapped vertices are at most a few pixels from them and
+        // the edge values are small enough for 32 bits.
+        int e[2][3];
+        int covered = 0; // Bit 2 * row + column for every covered pixel centre
+        for (int y = y0; y < y1; y++) {
+            for (unsigned int i = 0; i < 3; i++)
+                e[y - y0][i] = (int)((long long)edgeStepX[i] * x0 + (long long)edgeStepY[i] * y + setup.edgeOrigin[i]);
+            for (int x = x0; x < x1; x++) {
+                int step = x - x0;
+                const int* r = e[y - y0];
+                if (((r[0] + step * edgeStepX[0]) | (r[1] + step * edgeStepX[1]) | (r[2] + step * edgeStepX[2])) >= 0)
+                    covered |= 1 << ((y - y0) * 2 + step);
+            }
+        }
+        if (!covered) return 0;
+
+        int drawn = 0, tested = 0;
+        for (int y = y0; y < y1; y++) {
+            int bits = (covered >> ((y - y0) * 2)) & 3;
+            if (!bits) continue;
+
+            // Only the covered pixels of the row are handed on, so their tiles are the ones to clear
+            int first = (bits & 1) ? x0 : x0 + 1;
+            int last = (bits & 2) ? x0 + 1 : x0;
+            const int* r = e[y - y0];
+            int re[3];
+            float w[3];
+            for (unsigned int i = 0; i < 3; i++) {
+                re[i] = r[i] + (first - x0) * edgeStepX[i];
+                w[i] = edgeA[i] * first + edgeB[i] * y + edgeC[i];
+            }
+            renderer.zbuffer.prepareTile(first / blockSize, y / blockSize);
+            renderer.zbuffer.prepareTile(last / blockSize, y / blockSize);
+            drawn += row(first, y, last - first + 1, w, re, false, tested);
+        }
+
+        if (Pass != DepthPass::Prepass) {
+            RenderStats& stats = localStats();
+            stats.pixelsTested += tested;
+            stats.pixels += drawn;
+        }
+        return drawn;
+    }
+
+public:
+
+    // Shade a run of pixels in one row of a block, one pixel at a time
+    // With Equal set, pixels pass when their depth equals the Z-buffer (after a depth prepass)
+    // and the Z-buffer is not written
+    // Input Variables:
+    // - renderer: Renderer object for drawing
+    // - L: Light object with a normalised direction
+    // - kd: Diffuse lighting coefficient
+    // - x, y: First pixel of the run
+    // - count: Number of pixels in the run
+    // - w: Edge values at the first pixel, for interpolation
+    // - e: Fixed-point edge values at the first pixel, for coverage
+    // - inside: True if the whole run is known to be inside the triangle
+    // Output Variables:
+    // - tested: Incremented by the number of covered pixels that were depth tested
+    // Returns the number of pixels written
+    template <bool Equal>
+    int shadeRowScalar(Renderer& renderer, Light& L, float kd, int x, int y, int count, const float* w, const int* e, bool inside, int& tested) {
+        float w0 = w[0], w1 = w[1], w2 = w[2];
+        int e0 = e[0], e1 = e[1], e2 = e[2];
+        int written = 0;
+
+        for (int end = x + count; x < end; x++) {
+            // Check if the pixel lies inside the triangle: no edge value is negative
+            if (inside || (e0 | e1 | e2) >= 0) {
+                tested++;
+                float alpha = w0 * invArea;
+                float beta = w1 * invArea;
+                float gamma = w2 * invArea;
+
+                // Depth first, hidden pixels skip the remaining interpolation and the shader
+                float depth = interpolate(alpha, beta, gamma, setup.z[0], setup.z[1], setup.z[2]);
+                float stored = renderer.zbuffer(x, y);
+                if ((Equal ? stored >= depth : stored > depth) && depth > 0.01f) {
+                    // Interpolate color and normals
+                    colour c = interpolate(alpha, beta, gamma, attributes.rgb[0], attributes.rgb[1], attributes.rgb[2]);
                     c.clampColour();
-                    float depth = interpolate(beta, gamma, alpha, v[0].p[2], v[1].p[2], v[2].p[2]);
-                    vec4 normal = interpolate(beta, gamma, alpha, v[0].normal, v[1].normal, v[2].normal);
+                    vec4 normal = interpolate(alpha, beta, gamma, attributes.normal[0], attributes.normal[1], attributes.normal[2]);
                     normal.normalise();
 
-                    // Perform Z-buffer test and apply shading
-                    if (renderer.zbuffer(x, y) > depth && depth > 0.01f) {
-                        // typical shader begin
-                        L.omega_i.normalise();
-                        float dot = max(vec4::dot(L.omega_i, normal), 0.0f);
-                        colour a = (c * kd) * (L.L * dot + (L.ambient * kd));
-                        // typical shader end
-                        unsigned char r, g, b;
-                        a.toRGB(r, g, b);
-                        renderer.canvas.draw(x, y, r, g, b);
-                        renderer.zbuffer(x, y) = depth;
+                    // typical shader begin
+                    float dot = max(vec4::dot(L.omega_i, normal), 0.0f);
+                    colour a = (c * kd) * (L.L * dot + (L.ambient * kd));
+                    // typical shader end
+                    unsigned char r, g, b;
+                    a.toRGB(r, g, b);
+                    renderer.canvas.draw(x, y, r, g, b);
+                    if (!Equal) renderer.zbuffer(x, y) = depth;
+                    if (renderer.overdrawHeatmap) renderer.countOverdraw(x, y);
+                    written++;
+                }
+            }
+
+            // Step the edge values one pixel to the right
+            w0 += edgeA[0];
+            w1 += edgeA[1];
+            w2 += edgeA[2];
+            e0 += edgeStepX[0];
+            e1 += edgeStepX[1];
+            e2 += edgeStepX[2];
+        }
+        return written;
+    }
+
+    // Coverage of 4 pixels of a run from the fixed-point edge values: a lane is covered when none
+    // of its three edge values is negative, that is when the sign bit of their OR is clear
+    // Input Variables:
+    // - e: Fixed-point edge values at the first pixel of the run
+    // - first: Offset of the first of the 4 pixels in the run
+    // Returns an all-ones lane mask for the covered pixels
+    SIMD_TARGET_SSE41 __m128 cover4(const int* e, int first) const {
+        const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+        __m128i any = _mm_setzero_si128();
+        for (unsigned int i = 0; i < 3; i++)
+            any = _mm_or_si128(any, _mm_add_epi32(_mm_set1_epi32(e[i] + first * edgeStepX[i]), _mm_mullo_epi32(lane, _mm_set1_epi32(edgeStepX[i]))));
+        return _mm_castsi128_ps(_mm_cmpgt_epi32(any, _mm_set1_epi32(-1)));
+    }
+
+    // Coverage of the 8 pixels of a run, as cover4
+    SIMD_TARGET_AVX2 __m256 cover8(const int* e) const {
+        const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i any = _mm256_setzero_si256();
+        for (unsigned int i = 0; i < 3; i++)
+            any = _mm256_or_si256(any, _mm256_add_epi32(_mm256_set1_epi32(e[i]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(edgeStepX[i]))));
+        return _mm256_castsi256_ps(_mm256_cmpgt_epi32(any, _mm256_set1_epi32(-1)));
+    }
+
+    // Interpolate a per-vertex value for 4 pixels with their barycentric coordinates
+    SIMD_TARGET_SSE41 static __m128 lerp4(float a0, float a1, float a2, __m128 alpha, __m128 beta, __m128 gamma) {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a0), alpha), _mm_mul_ps(_mm_set1_ps(a1), beta)), _mm_mul_ps(_mm_set1_ps(a2), gamma));
+    }
+
+    // Interpolate a per-vertex value for 8 pixels with their barycentric coordinates
+    SIMD_TARGET_AVX2 static __m256 lerp8(float a0, float a1, float a2, __m256 alpha, __m256 beta, __m256 gamma) {
+        return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a0), alpha), _mm256_mul_ps(_mm256_set1_ps(a1), beta)), _mm256_mul_ps(_mm256_set1_ps(a2), gamma));
+    }
+
+    // Interpolate colour and normal for 4 pixels and run the Lambert shader on them
+    // Input Variables:
+    // - L: Light object with a normalised direction
+    // - kd: Diffuse lighting coefficient
+    // - alpha, beta, gamma: Barycentric coordinates of the pixels
+    // Output Variables:
+    // - r, g, b: Shaded colour of each pixel, 0 to 255
+    SIMD_TARGET_SSE41 void shade4(Light& L, float kd, __m128 alpha, __m128 beta, __m128 gamma, __m128i& r, __m128i& g, __m128i& b) {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.f);
+        __m128 cr = _mm_min_ps(lerp4(attributes.rgb[0][colour::RED], attributes.rgb[1][colour::RED], attributes.rgb[2][colour::RED], alpha, beta, gamma), one);
+        __m128 cg = _mm_min_ps(lerp4(attributes.rgb[0][colour::GREEN], attributes.rgb[1][colour::GREEN], attributes.rgb[2][colour::GREEN], alpha, beta, gamma), one);
+        __m128 cb = _mm_min_ps(lerp4(attributes.rgb[0][colour::BLUE], attributes.rgb[1][colour::BLUE], attributes.rgb[2][colour::BLUE], alpha, beta, gamma), one);
+        __m128 nx = lerp4(attributes.normal[0][0], attributes.normal[1][0], attributes.normal[2][0], alpha, beta, gamma);
+        __m128 ny = lerp4(attributes.normal[0][1], attributes.normal[1][1], attributes.normal[2][1], alpha, beta, gamma);
+        __m128 nz = lerp4(attributes.normal[0][2], attributes.normal[1][2], attributes.normal[2][2], alpha, beta, gamma);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+        nx = _mm_div_ps(nx, length);
+        ny = _mm_div_ps(ny, length);
+        nz = _mm_div_ps(nz, length);
+
+        // typical shader begin
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(L.omega_i[0]), nx), _mm_mul_ps(_mm_set1_ps(L.omega_i[1]), ny)), _mm_mul_ps(_mm_set1_ps(L.omega_i[2]), nz));
+        dot = _mm_max_ps(dot, zero);
+        __m128 vkd = _mm_set1_ps(kd);
+        __m128 lr = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(L.L[colour::RED]), dot), _mm_set1_ps(L.ambient[colour::RED] * kd));
+        __m128 lg = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(L.L[colour::GREEN]), dot), _mm_set1_ps(L.ambient[colour::GREEN] * kd));
+        __m128 lb = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(L.L[colour::BLUE]), dot), _mm_set1_ps(L.ambient[colour::BLUE] * kd));
+        __m128 scale = _mm_set1_ps(255.f);
+        r = _mm_cvttps_epi32(_mm_floor_ps(_mm_mul_ps(_mm_mul_ps(_mm_mul_ps(cr, vkd), lr), scale)));
+        g = _mm_cvttps_epi32(_mm_floor_ps(_mm_mul_ps(_mm_mul_ps(_mm_mul_ps(cg, vkd), lg), scale)));
+        b = _mm_cvttps_epi32(_mm_floor_ps(_mm_mul_ps(_mm_mul_ps(_mm_mul_ps(cb, vkd), lb), scale)));
+        // typical shader end
+    }
+
+    // Interpolate colour and normal for 8 pixels and run the Lambert shader on them
+    // Input Variables: as for shade4
+    // Output Variables: as for shade4
+    SIMD_TARGET_AVX2 void shade8(Light& L, float kd, __m256 alpha, __m256 beta, __m256 gamma, __m256i& r, __m256i& g, __m256i& b) {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.f);
+        __m256 cr = _mm256_min_ps(lerp8(attributes.rgb[0][colour::RED], attributes.rgb[1][colour::RED], attributes.rgb[2][colour::RED], alpha, beta, gamma), one);
+        __m256 cg = _mm256_min_ps(lerp8(attributes.rgb[0][colour::GREEN], attributes.rgb[1][colour::GREEN], attributes.rgb[2][colour::GREEN], alpha, beta, gamma), one);
+        __m256 cb = _mm256_min_ps(lerp8(attributes.rgb[0][colour::BLUE], attributes.rgb[1][colour::BLUE], attributes.rgb[2][colour::BLUE], alpha, beta, gamma), one);
+        __m256 nx = lerp8(attributes.normal[0][0], attributes.normal[1][0], attributes.normal[2][0], alpha, beta, gamma);
+        __m256 ny = lerp8(attributes.normal[0][1], attributes.normal[1][1], attributes.normal[2][1], alpha, beta, gamma);
+        __m256 nz = lerp8(attributes.normal[0][2], attributes.normal[1][2], attributes.normal[2][2], alpha, beta, gamma);
+        __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz)));
+        nx = _mm256_div_ps(nx, length);
+        ny = _mm256_div_ps(ny, length);
+        nz = _mm256_div_ps(nz, length);
+
+        // typical shader begin
+        __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(L.omega_i[0]), nx), _mm256_mul_ps(_mm256_set1_ps(L.omega_i[1]), ny)), _mm256_mul_ps(_mm256_set1_ps(L.omega_i[2]), nz));
+        dot = _mm256_max_ps(dot, zero);
+        __m256 vkd = _mm256_set1_ps(kd);
+        __m256 lr = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(L.L[colour::RED]), dot), _mm256_set1_ps(L.ambient[colour::RED] * kd));
+        __m256 lg = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(L.L[colour::GREEN]), dot), _mm256_set1_ps(L.ambient[colour::GREEN] * kd));
+        __m256 lb = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(L.L[colour::BLUE]), dot), _mm256_set1_ps(L.ambient[colour::BLUE] * kd));
+        __m256 scale = _mm256_set1_ps(255.f);
+        r = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(cr, vkd), lr), scale)));
+        g = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(cg, vkd), lg), scale)));
+        b = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(cb, vkd), lb), scale)));
+        // typical shader end
+    }
+
+    // Pack 4 shaded colours into BGRA32 pixels, keeping the low 8 bits of each channel like the byte writes of draw()
+    SIMD_TARGET_SSE41 static __m128i pack4(__m128i r, __m128i g, __m128i b) {
+        const __m128i byte = _mm_set1_epi32(0xFF);
+        __m128i p = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(r, byte), 16), _mm_slli_epi32(_mm_and_si128(g, byte), 8));
+        return _mm_or_si128(_mm_or_si128(p, _mm_and_si128(b, byte)), _mm_set1_epi32((int)0xFF000000));
+    }
+
+    // Pack 8 shaded colours into BGRA32 pixels, as pack4
+    SIMD_TARGET_AVX2 static __m256i pack8(__m256i r, __m256i g, __m256i b) {
+        const __m256i byte = _mm256_set1_epi32(0xFF);
+        __m256i p = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(r, byte), 16), _mm256_slli_epi32(_mm256_and_si256(g, byte), 8));
+        return _mm256_or_si256(_mm256_or_si256(p, _mm256_and_si256(b, byte)), _mm256_set1_epi32((int)0xFF000000));
+    }
+
+    // Shade a run of up to 8 pixels in one row of a block, 4 pixels per SSE4.1 register.
+    // Pixels go through coverage, depth interpolation and test, then attribute interpolation
+    // and shading (shade4) under lane masks. Each stage is skipped once no lane is left, and only the
+    // lanes that pass are written to the canvas and Z-buffer.
+    // Input Variables: as for shadeRowScalar
+    template <bool Equal>
+    SIMD_TARGET_SSE41 int shadeRowSSE41(Renderer& renderer, Light& L, float kd, int x, int y, int count, const float* w, const int* e, bool inside, int& tested) {
+        int written = 0;
+        const __m128 lane = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+
+        for (int first = 0; first < count; first += 4) {
+            int lanes = min(count - first, 4);
+
+            // Edge values for the four pixels and the coverage mask
+            __m128 offset = _mm_add_ps(lane, _mm_set1_ps((float)first));
+            __m128 w0 = _mm_add_ps(_mm_set1_ps(w[0]), _mm_mul_ps(offset, _mm_set1_ps(edgeA[0])));
+            __m128 w1 = _mm_add_ps(_mm_set1_ps(w[1]), _mm_mul_ps(offset, _mm_set1_ps(edgeA[1])));
+            __m128 w2 = _mm_add_ps(_mm_set1_ps(w[2]), _mm_mul_ps(offset, _mm_set1_ps(edgeA[2])));
+            __m128 mask = _mm_cmplt_ps(lane, _mm_set1_ps((float)lanes));
+            if (!inside) mask = _mm_and_ps(mask, cover4(e, first));
+            int covered = _mm_movemask_ps(mask);
+            if (covered == 0) continue;
+            tested += std::popcount((unsigned int)covered);
+
+            __m128 invA = _mm_set1_ps(invArea);
+            __m128 alpha = _mm_mul_ps(w0, invA);
+            __m128 beta = _mm_mul_ps(w1, invA);
+            __m128 gamma = _mm_mul_ps(w2, invA);
+
+            // Z-buffer test on the interpolated depth, lanes past the end of the run read a depth that always fails
+            __m128 depth = lerp4(setup.z[0], setup.z[1], setup.z[2], alpha, beta, gamma);
+            float* zrow = &renderer.zbuffer(x + first, y);
+            __m128 zb;
+            if (lanes == 4) {
+                zb = _mm_loadu_ps(zrow);
+            } else {
+                float tmp[4] = { 0.f, 0.f, 0.f, 0.f };
+                for (int i = 0; i < lanes; i++) tmp[i] = zrow[i];
+                zb = _mm_loadu_ps(tmp);
+            }
+            mask = _mm_and_ps(mask, Equal ? _mm_cmpge_ps(zb, depth) : _mm_cmpgt_ps(zb, depth));
+            mask = _mm_and_ps(mask, _mm_cmpgt_ps(depth, _mm_set1_ps(0.01f)));
+            int bits = _mm_movemask_ps(mask);
+            if (bits == 0) continue;
+
+            // Interpolate color and normals for the lanes still alive and shade them
+            __m128i r, g, b;
+            shade4(L, kd, alpha, beta, gamma, r, g, b);
+
+            // A packed back buffer takes the colours with one blended store when the run covers all four
+            // pixels, the pixels after a shorter run may belong to another tile and are written one by one
+            unsigned int* row = renderer.canvas.packedRow(y);
+            alignas(16) int rs[4], gs[4], bs[4];
+            alignas(16) unsigned int ps[4];
+            alignas(16) float ds[4];
+            if (row) {
+                __m128i packed = pack4(r, g, b);
+                if (lanes == 4) {
+                    __m128i* dst = (__m128i*)(row + x + first);
+                    _mm_storeu_si128(dst, _mm_blendv_epi8(_mm_loadu_si128(dst), packed, _mm_castps_si128(mask)));
+                }
+                else {
+                    _mm_store_si128((__m128i*)ps, packed);
+                }
+            }
+            else {
+                _mm_store_si128((__m128i*)rs, r);
+                _mm_store_si128((__m128i*)gs, g);
+                _mm_store_si128((__m128i*)bs, b);
+            }
+            _mm_store_ps(ds, depth);
+            for (int i = 0; i < 4; i++) {
+                if (bits & (1 << i)) {
+                    if (!row) renderer.canvas.draw(x + first + i, y, (unsigned char)rs[i], (unsigned char)gs[i], (unsigned char)bs[i]);
+                    else if (lanes < 4) row[x + first + i] = ps[i];
+                    if (!Equal) zrow[i] = ds[i];
+                    if (renderer.overdrawHeatmap) renderer.countOverdraw(x + first + i, y);
+                }
+            }
+            written += std::popcount((unsigned int)bits);
+        }
+        return written;
+    }
+
+    // Shade a run of up to 8 pixels in one row of a block with a single AVX2 register.
+    // Works like shadeRowSSE41, with all 8 pixels of a block row in one pass.
+    // Input Variables: as for shadeRowScalar
+    template <bool Equal>
+    SIMD_TARGET_AVX2 int shadeRowAVX2(Renderer& renderer, Light& L, float kd, int x, int y, int count, const float* w, const int* e, bool inside, int& tested) {
+        const __m256 lane = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+
+        // Edge values for the eight pixels and the coverage mask
+        __m256 w0 = _mm256_add_ps(_mm256_set1_ps(w[0]), _mm256_mul_ps(lane, _mm256_set1_ps(edgeA[0])));
+        __m256 w1 = _mm256_add_ps(_mm256_set1_ps(w[1]), _mm256_mul_ps(lane, _mm256_set1_ps(edgeA[1])));
+        __m256 w2 = _mm256_add_ps(_mm256_set1_ps(w[2]), _mm256_mul_ps(lane, _mm256_set1_ps(edgeA[2])));
+        __m256 mask = _mm256_cmp_ps(lane, _mm256_set1_ps((float)count), _CMP_LT_OQ);
+        if (!inside) mask = _mm256_and_ps(mask, cover8(e));
+        int covered = _mm256_movemask_ps(mask);
+        if (covered == 0) return 0;
+        tested += std::popcount((unsigned int)covered);
+
+        __m256 invA = _mm256_set1_ps(invArea);
+        __m256 alpha = _mm256_mul_ps(w0, invA);
+        __m256 beta = _mm256_mul_ps(w1, invA);
+        __m256 gamma = _mm256_mul_ps(w2, invA);
+
+        // Z-buffer test on the interpolated depth, with a masked load so lanes past the end of the run are never touched
+        __m256 depth = lerp8(setup.z[0], setup.z[1], setup.z[2], alpha, beta, gamma);
+        float* zrow = &renderer.zbuffer(x, y);
+        __m256i valid = _mm256_castps_si256(_mm256_cmp_ps(lane, _mm256_set1_ps((float)count), _CMP_LT_OQ));
+        __m256 zb = _mm256_maskload_ps(zrow, valid);
+        mask = _mm256_and_ps(mask, Equal ? _mm256_cmp_ps(zb, depth, _CMP_GE_OQ) : _mm256_cmp_ps(zb, depth, _CMP_GT_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(depth, _mm256_set1_ps(0.01f), _CMP_GT_OQ));
+        int bits = _mm256_movemask_ps(mask);
+        if (bits == 0) return 0;
+
+        // Interpolate color and normals for the lanes still alive and shade them
+        __m256i r, g, b;
+        shade8(L, kd, alpha, beta, gamma, r, g, b);
+
+        // Depth write under the pass mask
+        if (!Equal) _mm256_maskstore_ps(zrow, _mm256_castps_si256(mask), depth);
+
+        // Colour write under the same mask, one masked store into a packed back buffer
+        if (unsigned int* row = renderer.canvas.packedRow(y)) {
+            _mm256_maskstore_epi32((int*)(row + x), _mm256_castps_si256(mask), pack8(r, g, b));
+        }
+        else {
+            alignas(32) int rs[8], gs[8], bs[8];
+            _mm256_store_si256((__m256i*)rs, r);
+            _mm256_store_si256((__m256i*)gs, g);
+            _mm256_store_si256((__m256i*)bs, b);
+            for (int i = 0; i < 8; i++)
+                if (bits & (1 << i))
+                    renderer.canvas.draw(x + i, y, (unsigned char)rs[i], (unsigned char)gs[i], (unsigned char)bs[i]);
+        }
+        if (renderer.overdrawHeatmap) {
+            for (int i = 0; i < 8; i++)
+                if (bits & (1 << i)) renderer.countOverdraw(x + i, y);
+        }
+        return std::popcount((unsigned int)bits);
+    }
+
+    // Depth test a run of pixels in one row of a block for the visibility buffer, one pixel
+    // at a time. Depth is interpolated exactly as in shadeRowScalar, so both modes keep the
+    // same surfaces. Pixels that pass store their depth, and the triangle's ID with WriteID set
+    // (without it this is the depth prepass kernel).
+    // Input Variables:
+    // - renderer: Renderer object holding the Z-buffer and visibility buffer
+    // - id: Value stored for the pixels that pass
+    // - x, y, count, w, e, inside: as for shadeRowScalar
+    // Output Variables:
+    // - tested: Incremented by the number of covered pixels that were depth tested
+    // Returns the number of pixels written
+    template <bool WriteID>
+    int depthRowScalar(Renderer& renderer, unsigned int id, int x, int y, int count, const float* w, const int* e, bool inside, int& tested) {
+        float w0 = w[0], w1 = w[1], w2 = w[2];
+        int e0 = e[0], e1 = e[1], e2 = e[2];
+        unsigned int* ids = WriteID ? &renderer.visibility[y * renderer.canvas.getWidth()] : nullptr;
+        int written = 0;
+
+        for (int end = x + count; x < end; x++) {
+            if (inside || (e0 | e1 | e2) >= 0) {
+                tested++;
+                float depth = interpolate(w0 * invArea, w1 * invArea, w2 * invArea, setup.z[0], setup.z[1], setup.z[2]);
+                if (renderer.zbuffer(x, y) > depth && depth > 0.01f) {
+                    renderer.zbuffer(x, y) = depth;
+                    if (WriteID) {
+                        ids[x] = id;
+                        if (renderer.overdrawHeatmap) renderer.countOverdraw(x, y);
+                    }
+                    written++;
+                }
+            }
+
+            // Step the edge values one pixel to the right
+            w0 += edgeA[0];
+            w1 += edgeA[1];
+            w2 += edgeA[2];
+            e0 += edgeStepX[0];
+            e1 += edgeStepX[1];
+            e2 += edgeStepX[2];
+        }
+        return written;
+    }
+
+    // Depth test a run of up to 8 pixels for the visibility buffer, 4 pixels per SSE4.1 register
+    // Input Variables: as for depthRowScalar
+    template <bool WriteID>
+    SIMD_TARGET_SSE41 int depthRowSSE41(Renderer& renderer, unsigned int id, int x, int y, int count, const float* w, const int* e, bool inside, int& tested) {
+        int written = 0;
+        const __m128 lane = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+        unsigned int* ids = WriteID ? &renderer.visibility[y * renderer.canvas.getWidth() + x] : nullptr;
+
+        for (int first = 0; first < count; first += 4) {
+            int lanes = min(count - first, 4);
+
+            // Edge values for the four pixels and the coverage mask
+            __m128 offset = _mm_add_ps(lane, _mm_set1_ps((float)first));
+            __m128 w0 = _mm_add_ps(_mm_set1_ps(w[0]), _mm_mul_ps(offset, _mm_set1_ps(edgeA[0])));
+            __m128 w1 = _mm_add_ps(_mm_set1_ps(w[1]), _mm_mul_ps(offset, _mm_set1_ps(edgeA[1])));
+            __m128 w2 = _mm_add_ps(_mm_set1_ps(w[2]), _mm_mul_ps(offset, _mm_set1_ps(edgeA[2])));
+            __m128 mask = _mm_cmplt_ps(lane, _mm_set1_ps((float)lanes));
+            if (!inside) mask = _mm_and_ps(mask, cover4(e, first));
+            int covered = _mm_movemask_ps(mask);
+            if (covered == 0) continue;
+            tested += std::popcount((unsigned int)covered);
+
+            __m128 invA = _mm_set1_ps(invArea);
+            __m128 depth = lerp4(setup.z[0], setup.z[1], setup.z[2], _mm_mul_ps(w0, invA), _mm_mul_ps(w1, invA), _mm_mul_ps(w2, invA));
+            float* zrow = &renderer.zbuffer(x + first, y);
+            __m128 zb;
+            if (lanes == 4) {
+                zb = _mm_loadu_ps(zrow);
+            } else {
+                float tmp[4] = { 0.f, 0.f, 0.f, 0.f };
+                for (int i = 0; i < lanes; i++) tmp[i] = zrow[i];
+                zb = _mm_loadu_ps(tmp);
+            }
+            mask = _mm_and_ps(mask, _mm_cmpgt_ps(zb, depth));
+            mask = _mm_and_ps(mask, _mm_cmpgt_ps(depth, _mm_set1_ps(0.01f)));
+            int bits = _mm_movemask_ps(mask);
+            if (bits == 0) continue;
+
+            alignas(16) float ds[4];
+            _mm_store_ps(ds, depth);
+            for (int i = 0; i < 4; i++) {
+                if (bits & (1 << i)) {
+                    zrow[i] = ds[i];
+                    if (WriteID) {
+                        ids[first + i] = id;
+                        if (renderer.overdrawHeatmap) renderer.countOverdraw(x + first + i, y);
                     }
                 }
             }
+            written += std::popcount((unsigned int)bits);
         }
+        return written;
     }
 
-    // Compute the 2D bounds of the triangle
+    // Depth test a run of up to 8 pixels for the visibility buffer with a single AVX2 register,
+    // storing depths and IDs with masked stores
+    // Input Variables: as for depthRowScalar
+    template <bool WriteID>
+    SIMD_TARGET_AVX2 int depthRowAVX2(Renderer& renderer, unsigned int id, int x, int y, int count, const float* w, const int* e, bool inside, int& tested) {
+        const __m256 lane = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+
+        // Edge values for the eight pixels and the coverage mask
+        __m256 w0 = _mm256_add_ps(_mm256_set1_ps(w[0]), _mm256_mul_ps(lane, _mm256_set1_ps(edgeA[0])));
+        __m256 w1 = _mm256_add_ps(_mm256_set1_ps(w[1]), _mm256_mul_ps(lane, _mm256_set1_ps(edgeA[1])));
+        __m256 w2 = _mm256_add_ps(_mm256_set1_ps(w[2]), _mm256_mul_ps(lane, _mm256_set1_ps(edgeA[2])));
+        __m256 mask = _mm256_cmp_ps(lane, _mm256_set1_ps((float)count), _CMP_LT_OQ);
+        if (!inside) mask = _mm256_and_ps(mask, cover8(e));
+        int covered = _mm256_movemask_ps(mask);
+        if (covered == 0) return 0;
+        tested += std::popcount((unsigned int)covered);
+
+        __m256 invA = _mm256_set1_ps(invArea);
+        __m256 depth = lerp8(setup.z[0], setup.z[1], setup.z[2], _mm256_mul_ps(w0, invA), _mm256_mul_ps(w1, invA), _mm256_mul_ps(w2, invA));
+        float* zrow = &renderer.zbuffer(x, y);
+        __m256i valid = _mm256_castps_si256(_mm256_cmp_ps(lane, _mm256_set1_ps((float)count), _CMP_LT_OQ));
+        __m256 zb = _mm256_maskload_ps(zrow, valid);
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(zb, depth, _CMP_GT_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(depth, _mm256_set1_ps(0.01f), _CMP_GT_OQ));
+        int bits = _mm256_movemask_ps(mask);
+        if (bits == 0) return 0;
+
+        __m256i pass = _mm256_castps_si256(mask);
+        _mm256_maskstore_ps(zrow, pass, depth);
+        if (!WriteID) return std::popcount((unsigned int)bits);
+
+        unsigned int* ids = &renderer.visibility[y * renderer.canvas.getWidth() + x];
+        _mm256_maskstore_epi32((int*)ids, pass, _mm256_set1_epi32((int)id));
+        if (renderer.overdrawHeatmap) {
+            for (int i = 0; i < 8; i++)
+                if (bits & (1 << i)) renderer.countOverdraw(x + i, y);
+        }
+        return std::popcount((unsigned int)bits);
+    }
+
+    // Shade a run of pixels in one row that the visibility buffer holds for this triangle.
+    // The barycentric coordinates are rebuilt from the edge equations at the pixels and
+    // shaded as in the forward kernels, picked from the instruction sets this CPU supports.
+    // Input Variables:
+    // - renderer: Renderer object for drawing
+    // - L: Light object with a normalised direction
+    // - x, y: First pixel of the run
+    // - count: Number of pixels in the run
+    void resolveRun(Renderer& renderer, Light& L, int x, int y, int count) {
+        switch (simdLevel()) {
+        case SimdLevel::AVX2: resolveRunAVX2(renderer, L, x, y, count); break;
+        case SimdLevel::SSE41: resolveRunSSE41(renderer, L, x, y, count); break;
+        default: resolveRunScalar(renderer, L, x, y, count); break;
+        }
+    }
+
+    // Shade a run of visibility-buffer pixels one at a time
+    // Input Variables: as for resolveRun
+    void resolveRunScalar(Renderer& renderer, Light& L, int x, int y, int count) {
+        float w0 = edgeA[0] * x + edgeB[0] * y + edgeC[0];
+        float w1 = edgeA[1] * x + edgeB[1] * y + edgeC[1];
+        float w2 = edgeA[2] * x + edgeB[2] * y + edgeC[2];
+
+        for (int end = x + count; x < end; x++) {
+            float alpha = w0 * invArea;
+            float beta = w1 * invArea;
+            float gamma = w2 * invArea;
+
+            colour c = interpolate(alpha, beta, gamma, attributes.rgb[0], attributes.rgb[1], attributes.rgb[2]);
+            c.clampColour();
+            vec4 normal = interpolate(alpha, beta, gamma, attributes.normal[0], attributes.normal[1], attributes.normal[2]);
+            normal.normalise();
+
+            // typical shader begin
+            float dot = max(vec4::dot(L.omega_i, normal), 0.0f);
+            colour a = (c * attributes.kd) * (L.L * dot + (L.ambient * attributes.kd));
+            // typical shader end
+            unsigned char r, g, b;
+            a.toRGB(r, g, b);
+            renderer.canvas.draw(x, y, r, g, b);
+
+            w0 += edgeA[0];
+            w1 += edgeA[1];
+            w2 += edgeA[2];
+        }
+    }
+
+    // Shade a run of visibility-buffer pixels 4 at a time with SSE4.1
+    // Input Variables: as for resolveRun
+    SIMD_TARGET_SSE41 void resolveRunSSE41(Renderer& renderer, Light& L, int x, int y, int count) {
+        const __m128 lane = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+        const __m128 invA = _mm_set1_ps(invArea);
+        float w[3];
+        for (unsigned int i = 0; i < 3; i++)
+            w[i] = edgeA[i] * x + edgeB[i] * y + edgeC[i];
+
+        for (int first = 0; first < count; first += 4) {
+            __m128 offset = _mm_add_ps(lane, _mm_set1_ps((float)first));
+            __m128 alpha = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(w[0]), _mm_mul_ps(offset, _mm_set1_ps(edgeA[0]))), invA);
+            __m128 beta = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(w[1]), _mm_mul_ps(offset, _mm_set1_ps(edgeA[1]))), invA);
+            __m128 gamma = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(w[2]), _mm_mul_ps(offset, _mm_set1_ps(edgeA[2]))), invA);
+            __m128i r, g, b;
+            shade4(L, attributes.kd, alpha, beta, gamma, r, g, b);
+
+            int lanes = min(count - first, 4);
+            if (unsigned int* row = renderer.canvas.packedRow(y)) {
+                __m128i packed = pack4(r, g, b);
+                if (lanes == 4) {
+                    _mm_storeu_si128((__m128i*)(row + x + first), packed);
+                }
+                else {
+                    alignas(16) unsigned int ps[4];
+                    _mm_store_si128((__m128i*)ps, packed);
+                    for (int i = 0; i < lanes; i++)
+                        row[x + first + i] = ps[i];
+                }
+                continue;
+            }
+            alignas(16) int rs[4], gs[4], bs[4];
+            _mm_store_si128((__m128i*)rs, r);
+            _mm_store_si128((__m128i*)gs, g);
+            _mm_store_si128((__m128i*)bs, b);
+            for (int i = 0; i < lanes; i++)
+                renderer.canvas.draw(x + first + i, y, (unsigned char)rs[i], (unsigned char)gs[i], (unsigned char)bs[i]);
+        }
+    }
+
+    // Shade a run of visibility-buffer pixels 8 at a time with AVX2
+    // Input Variables: as for resolveRun
+    SIMD_TARGET_AVX2 void resolveRunAVX2(Renderer& renderer, Light& L, int x, int y, int count) {
+        const __m256 lane = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+        const __m256 invA = _mm256_set1_ps(invArea);
+        float w[3];
+        for (unsigned int i = 0; i < 3; i++)
+            w[i] = edgeA[i] * x + edgeB[i] * y + edgeC[i];
+
+        for (int first = 0; first < count; first += 8) {
+            __m256 offset = _mm256_add_ps(lane, _mm256_set1_ps((float)first));
+            __m256 alpha = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(w[0]), _mm256_mul_ps(offset, _mm256_set1_ps(edgeA[0]))), invA);
+            __m256 beta = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(w[1]), _mm256_mul_ps(offset, _mm256_set1_ps(edgeA[1]))), invA);
+            __m256 gamma = _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(w[2]), _mm256_mul_ps(offset, _mm256_set1_ps(edgeA[2]))), invA);
+            __m256i r, g, b;
+            shade8(L, attributes.kd, alpha, beta, gamma, r, g, b);
+
+            int lanes = min(count - first, 8);
+            if (unsigned int* row = renderer.canvas.packedRow(y)) {
+                __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(lanes), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+                _mm256_maskstore_epi32((int*)(row + x + first), valid, pack8(r, g, b));
+                continue;
+            }
+            alignas(32) int rs[8], gs[8], bs[8];
+            _mm256_store_si256((__m256i*)rs, r);
+            _mm256_store_si256((__m256i*)gs, g);
+            _mm256_store_si256((__m256i*)bs, b);
+            for (int i = 0; i < lanes; i++)
+                renderer.canvas.draw(x + first + i, y, (unsigned char)rs[i], (unsigned char)gs[i], (unsigned char)bs[i]);
+        }
+    }
+
+    // Compute the 2D bounds of the triangle's snapped vertices
     // Output Variables:
     // - minV, maxV: Minimum and maximum bounds in 2D space
-    void getBounds(vec2D& minV, vec2D& maxV) {
-        minV = vec2D(v[0].p);
-        maxV = vec2D(v[0].p);
-        for (unsigned int i = 1; i < 3; i++) {
-            minV.x = min(minV.x, v[i].p[0]);
-            minV.y = min(minV.y, v[i].p[1]);
-            maxV.x = max(maxV.x, v[i].p[0]);
-            maxV.y = max(maxV.y, v[i].p[1]);
-        }
+    void getBounds(vec2D& minV, vec2D& maxV) const {
+        const float unit = 1.f / subPixelScale;
+        minV = vec2D(min(setup.sx[0], min(setup.sx[1], setup.sx[2])) * unit, min(setup.sy[0], min(setup.sy[1], setup.sy[2])) * unit);
+        maxV = vec2D(max(setup.sx[0], max(setup.sx[1], setup.sx[2])) * unit, max(setup.sy[0], max(setup.sy[1], setup.sy[2])) * unit);
+    }
+
+    // Compute the pixels whose centres the triangle can cover, see TriSetup::getSampleBounds
+    void getSampleBounds(int& x0, int& y0, int& x1, int& y1) const {
+        setup.getSampleBounds(x0, y0, x1, y1);
     }
 
     // Compute the 2D bounds of the triangle, clipped to the canvas
@@ -155,7 +1093,7 @@ public:
     // - canvas: Reference to the rendering canvas
     // Output Variables:
     // - minV, maxV: Clipped minimum and maximum bounds
-    void getBoundsWindow(GamesEngineeringBase::Window& canvas, vec2D& minV, vec2D& maxV) {
+    void getBoundsWindow(RenderTarget& canvas, vec2D& minV, vec2D& maxV) const {
         getBounds(minV, maxV);
         minV.x = max(minV.x, 0);
         minV.y = max(minV.y, 0);
@@ -166,7 +1104,7 @@ public:
     // Debugging utility to display the triangle bounds on the canvas
     // Input Variables:
     // - canvas: Reference to the rendering canvas
-    void drawBounds(GamesEngineeringBase::Window& canvas) {
+    void drawBounds(RenderTarget& canvas) {
         vec2D minV, maxV;
         getBounds(minV, maxV);
 
@@ -179,8 +1117,9 @@ public:
 
     // Debugging utility to display the coordinates of the triangle vertices
     void display() {
+        const float unit = 1.f / subPixelScale;
         for (unsigned int i = 0; i < 3; i++) {
-            v[i].p.display();
+            vec4(setup.sx[i] * unit, setup.sy[i] * unit, setup.z[i], 1.f).display();
         }
         std::cout << std::endl;
     }
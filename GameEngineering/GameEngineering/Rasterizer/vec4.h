@@ -1,17 +1,26 @@
 #pragma once
 
+#include <cmath>
 #include <iostream>
+#include <immintrin.h>
 
 // The `vec4` class represents a 4D vector and provides operations such as scaling, addition, subtraction, 
 // normalization, and vector products (dot and cross).
+// The components share storage with an SSE register, so the arithmetic works on all four at once.
+// Every lane does the same operations in the same order as the scalar formulas, so results are
+// identical to computing the components one by one.
 class vec4 {
     union {
         struct {
             float x, y, z, w; // Components of the vector
         };
         float v[4];           // Array representation of the vector components
+        __m128 xyzw;          // SSE register representation of the vector components
     };
 
+    // Lane mask keeping x, y and z and clearing w
+    static __m128 maskXYZ() { return _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0)); }
+
 public:
     // Constructor to initialize the vector with specified values.
     // Default values: x = 0, y = 0, z = 0, w = 1.
@@ -23,6 +32,12 @@ public:
     vec4(float _x = 0.f, float _y = 0.f, float _z = 0.f, float _w = 1.f)
         : x(_x), y(_y), z(_z), w(_w) {}
 
+    // Constructor from an SSE register holding x, y, z and w in that order
+    explicit vec4(__m128 _xyzw) : xyzw(_xyzw) {}
+
+    // Returns the components as an SSE register
+    __m128 simd() const { return xyzw; }
+
     // Displays the components of the vector in a readable format.
     void display() {
         std::cout << x << '\t' << y << '\t' << z << '\t' << w << std::endl;
@@ -33,16 +48,14 @@ public:
     // - scalar: Value to scale the vector by
     // Returns a new scaled `vec4`.
     vec4 operator*(float scalar) const {
-        return { x * scalar, y * scalar, z * scalar, w * scalar };
+        return vec4(_mm_mul_ps(xyzw, _mm_set1_ps(scalar)));
     }
 
     // Divides the vector by its W component and sets W to 1.
     // Useful for normalizing the W component after transformations.
     void divideW() {
-        x /= w;
-        y /= w;
-        z /= w;
-        w = 1.f;
+        __m128 divided = _mm_and_ps(_mm_div_ps(xyzw, _mm_set1_ps(w)), maskXYZ());
+        xyzw = _mm_or_ps(divided, _mm_setr_ps(0.f, 0.f, 0.f, 1.f));
     }
 
     // Accesses a vector component by index.
@@ -66,7 +79,7 @@ public:
     // - other: The vector to subtract
     // Returns a new `vec4` resulting from the subtraction.
     vec4 operator-(const vec4& other) const {
-        return vec4(x - other.x, y - other.y, z - other.z, 0.0f);
+        return vec4(_mm_and_ps(_mm_sub_ps(xyzw, other.xyzw), maskXYZ()));
     }
 
     // Adds another vector to this vector.
@@ -74,7 +87,7 @@ public:
     // - other: The vector to add
     // Returns a new `vec4` resulting from the addition.
     vec4 operator+(const vec4& other) const {
-        return vec4(x + other.x, y + other.y, z + other.z, 0.0f);
+        return vec4(_mm_and_ps(_mm_add_ps(xyzw, other.xyzw), maskXYZ()));
     }
 
     // Computes the cross product of two vectors.
@@ -83,12 +96,13 @@ public:
     // - v2: The second vector
     // Returns a new `vec4` representing the cross product.
     static vec4 cross(const vec4& v1, const vec4& v2) {
-        return vec4(
-            v1.y * v2.z - v1.z * v2.y,
-            v1.z * v2.x - v1.x * v2.z,
-            v1.x * v2.y - v1.y * v2.x,
-            0.0f // The W component is set to 0 for cross products
-        );
+        // (y, z, x) * (z, x, y) - (z, x, y) * (y, z, x), one component per lane
+        __m128 a1 = _mm_shuffle_ps(v1.xyzw, v1.xyzw, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 b1 = _mm_shuffle_ps(v2.xyzw, v2.xyzw, _MM_SHUFFLE(3, 1, 0, 2));
+        __m128 a2 = _mm_shuffle_ps(v1.xyzw, v1.xyzw, _MM_SHUFFLE(3, 1, 0, 2));
+        __m128 b2 = _mm_shuffle_ps(v2.xyzw, v2.xyzw, _MM_SHUFFLE(3, 0, 2, 1));
+        // The W component is set to 0 for cross products
+        return vec4(_mm_and_ps(_mm_sub_ps(_mm_mul_ps(a1, b1), _mm_mul_ps(a2, b2)), maskXYZ()));
     }
 
     // Computes the dot product of two vectors.
@@ -104,9 +118,7 @@ public:
     // This operation does not affect the W component.
     void normalise() {
         float length = std::sqrt(x * x + y * y + z * z);
-        x /= length;
-        y /= length;
-        z /= length;
+        xyzw = _mm_div_ps(xyzw, _mm_setr_ps(length, length, length, 1.f));
     }
 };
 
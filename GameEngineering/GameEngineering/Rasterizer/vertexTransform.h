@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cmath>
+#include "simd.h"
+#include "alignedArray.h"
+#include "matrix.h"
+#include "mesh.h"
+#include "clipper.h"
+
+// Post-transform vertices of a mesh, one array per component.
+// Written by VertexTransform::transform and read back one vertex at a time during triangle assembly.
+struct TransformedVertices {
+    AlignedArray<float> x, y, z;    // Screen-space position and NDC depth
+    AlignedArray<float> nx, ny, nz; // World-space unit normals
+    AlignedArray<unsigned int> outcode; // Clip planes each vertex lies outside of, see Clipper::outcode
+
+    // Sizes every stream for n vertices, keeping existing allocations when possible
+    void resize(size_t n) {
+        AlignedArray<float>* arrays[] = { &x, &y, &z, &nx, &ny, &nz };
+        for (AlignedArray<float>* a : arrays)
+            a->resize(n);
+        outcode.resize(n);
+    }
+
+    // Builds the Vertex used by triangle setup for one transformed vertex
+    // Input Variables:
+    // - i: Index of the vertex
+    // - in: Source streams, provide the vertex colour
+    // Output Variables:
+    // - v: Screen-space vertex
+    void get(size_t i, const VertexStreams& in, Vertex& v) const {
+        v.p = vec4(x[i], y[i], z[i], 1.f);
+        v.normal = vec4(nx[i], ny[i], nz[i], 0.f);
+        v.rgb = colour(in.r[i], in.g[i], in.b[i]);
+    }
+};
+
+// Batched vertex transform: projects positions to screen space, records which clip planes each
+// vertex is outside of, and rotates normals into world space.
+// Processes 8 (AVX2) or 4 (SSE) vertices per iteration; the streams are padded so no tail loop is needed.
+// The arithmetic is done in the same order as matrix * vec4, so every path gives the same result
+// as transforming the vertices one by one.
+class VertexTransform {
+    // Matrix coefficients broadcast into registers once per mesh
+    struct Coefficients {
+        float p[16];    // Combined perspective, camera and world matrix
+        float w[9];     // Upper 3x3 of the world matrix, applied to normals
+        float width, height;
+    };
+
+    static void setup(const matrix& p, const matrix& world, float width, float height, Coefficients& c) {
+        for (unsigned int r = 0; r < 4; r++)
+            for (unsigned int col = 0; col < 4; col++)
+                c.p[r * 4 + col] = p(r, col);
+        for (unsigned int r = 0; r < 3; r++)
+            for (unsigned int col = 0; col < 3; col++)
+                c.w[r * 3 + col] = world(r, col);
+        c.width = width;
+        c.height = height;
+    }
+
+    static void transformScalar(const VertexStreams& in, const Coefficients& c, TransformedVertices& out) {
+        const float* m = c.p;
+        const float* w = c.w;
+        for (size_t i = 0; i < in.size(); i++) {
+            float x = in.px[i], y = in.py[i], z = in.pz[i];
+            float cx = m[0] * x + m[1] * y + m[2] * z + m[3];
+            float cy = m[4] * x + m[5] * y + m[6] * z + m[7];
+            float cz = m[8] * x + m[9] * y + m[10] * z + m[11];
+            float cw = m[12] * x + m[13] * y + m[14] * z + m[15];
+            out.outcode[i] = Clipper::outcode(vec4(cx, cy, cz, cw));
+            cx /= cw;
+            cy /= cw;
+            cz /= cw;
+
+            // Map normalized device coordinates to screen space, y pointing down
+            out.x[i] = (cx + 1.f) * 0.5f * c.width;
+            out.y[i] = c.height - (cy + 1.f) * 0.5f * c.height;
+            out.z[i] = cz;
+
+            float n0 = in.nx[i], n1 = in.ny[i], n2 = in.nz[i];
+            float wx = w[0] * n0 + w[1] * n1 + w[2] * n2;
+            float wy = w[3] * n0 + w[4] * n1 + w[5] * n2;
+            float wz = w[6] * n0 + w[7] * n1 + w[8] * n2;
+            float length = std::sqrt(wx * wx + wy * wy + wz * wz);
+            out.nx[i] = wx / length;
+            out.ny[i] = wy / length;
+            out.nz[i] = wz / length;
+        }
+    }
+
+    // Vector versions of Clipper::outcode, one comparison mask per plane turned into its bit
+    SIMD_TARGET_SSE41 static void outcodeSSE41(__m128 x, __m128 y, __m128 z, __m128 w, unsigned int* out) {
+        __m128 g = _mm_mul_ps(_mm_set1_ps(Clipper::guardBand), w);
+        __m128 ng = _mm_sub_ps(_mm_setzero_ps(), g);
+        __m128i code = _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(z, _mm_setzero_ps())), _mm_set1_epi32(CLIP_NEAR));
+        code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(z, w)), _mm_set1_epi32(CLIP_FAR)));
+        code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(x, ng)), _mm_set1_epi32(CLIP_LEFT)));
+        code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(x, g)), _mm_set1_epi32(CLIP_RIGHT)));
+        code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(y, ng)), _mm_set1_epi32(CLIP_BOTTOM)));
+        code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(y, g)), _mm_set1_epi32(CLIP_TOP)));
+        _mm_store_si128(reinterpret_cast<__m128i*>(out), code);
+    }
+
+    SIMD_TARGET_AVX2 static void outcodeAVX2(__m256 x, __m256 y, __m256 z, __m256 w, unsigned int* out) {
+        __m256 g = _mm256_mul_ps(_mm256_set1_ps(Clipper::guardBand), w);
+        __m256 ng = _mm256_sub_ps(_mm256_setzero_ps(), g);
+        __m256i code = _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_LT_OQ)), _mm256_set1_epi32(CLIP_NEAR));
+        code = _mm256_or_si256(code, _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(z, w, _CMP_GT_OQ)), _mm256_set1_epi32(CLIP_FAR)));
+        code = _mm256_or_si256(code, _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(x, ng, _CMP_LT_OQ)), _mm256_set1_epi32(CLIP_LEFT)));
+        code = _mm256_or_si256(code, _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(x, g, _CMP_GT_OQ)), _mm256_set1_epi32(CLIP_RIGHT)));
+        code = _mm256_or_si256(code, _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(y, ng, _CMP_LT_OQ)), _mm256_set1_epi32(CLIP_BOTTOM)));
+        code = _mm256_or_si256(code, _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(y, g, _CMP_GT_OQ)), _mm256_set1_epi32(CLIP_TOP)));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(out), code);
+    }
+
+    SIMD_TARGET_SSE41 static void transformSSE41(const VertexStreams& in, const Coefficients& c, TransformedVertices& out) {
+        __m128 m[16], w[9];
+        for (int k = 0; k < 16; k++) m[k] = _mm_set1_ps(c.p[k]);
+        for (int k = 0; k < 9; k++) w[k] = _mm_set1_ps(c.w[k]);
+        const __m128 one = _mm_set1_ps(1.f), half = _mm_set1_ps(0.5f);
+        const __m128 width = _mm_set1_ps(c.width), height = _mm_set1_ps(c.height);
+
+        for (size_t i = 0; i < in.px.paddedSize(); i += 4) {
+            __m128 x = _mm_load_ps(&in.px[i]), y = _mm_load_ps(&in.py[i]), z = _mm_load_ps(&in.pz[i]);
+            __m128 cx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], x), _mm_mul_ps(m[1], y)), _mm_mul_ps(m[2], z)), m[3]);
+            __m128 cy = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[4], x), _mm_mul_ps(m[5], y)), _mm_mul_ps(m[6], z)), m[7]);
+            __m128 cz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[8], x), _mm_mul_ps(m[9], y)), _mm_mul_ps(m[10], z)), m[11]);
+            __m128 cw = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[12], x), _mm_mul_ps(m[13], y)), _mm_mul_ps(m[14], z)), m[15]);
+            outcodeSSE41(cx, cy, cz, cw, &out.outcode[i]);
+            cx = _mm_div_ps(cx, cw);
+            cy = _mm_div_ps(cy, cw);
+            cz = _mm_div_ps(cz, cw);
+
+            _mm_store_ps(&out.x[i], _mm_mul_ps(_mm_mul_ps(_mm_add_ps(cx, one), half), width));
+            _mm_store_ps(&out.y[i], _mm_sub_ps(height, _mm_mul_ps(_mm_mul_ps(_mm_add_ps(cy, one), half), height)));
+            _mm_store_ps(&out.z[i], cz);
+
+            __m128 n0 = _mm_load_ps(&in.nx[i]), n1 = _mm_load_ps(&in.ny[i]), n2 = _mm_load_ps(&in.nz[i]);
+            __m128 wx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w[0], n0), _mm_mul_ps(w[1], n1)), _mm_mul_ps(w[2], n2));
+            __m128 wy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w[3], n0), _mm_mul_ps(w[4], n1)), _mm_mul_ps(w[5], n2));
+            __m128 wz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w[6], n0), _mm_mul_ps(w[7], n1)), _mm_mul_ps(w[8], n2));
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, wx), _mm_mul_ps(wy, wy)), _mm_mul_ps(wz, wz)));
+            _mm_store_ps(&out.nx[i], _mm_div_ps(wx, length));
+            _mm_store_ps(&out.ny[i], _mm_div_ps(wy, length));
+            _mm_store_ps(&out.nz[i], _mm_div_ps(wz, length));
+        }
+    }
+
+    SIMD_TARGET_AVX2 static void transformAVX2(const VertexStreams& in, const Coefficients& c, TransformedVertices& out) {
+        __m256 m[16], w[9];
+        for (int k = 0; k < 16; k++) m[k] = _mm256_set1_ps(c.p[k]);
+        for (int k = 0; k < 9; k++) w[k] = _mm256_set1_ps(c.w[k]);
+        const __m256 one = _mm256_set1_ps(1.f), half = _mm256_set1_ps(0.5f);
+        const __m256 width = _mm256_set1_ps(c.width), height = _mm256_set1_ps(c.height);
+
+        for (size_t i = 0; i < in.px.paddedSize(); i += 8) {
+            __m256 x = _mm256_load_ps(&in.px[i]), y = _mm256_load_ps(&in.py[i]), z = _mm256_load_ps(&in.pz[i]);
+            __m256 cx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], x), _mm256_mul_ps(m[1], y)), _mm256_mul_ps(m[2], z)), m[3]);
+            __m256 cy = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[4], x), _mm256_mul_ps(m[5], y)), _mm256_mul_ps(m[6], z)), m[7]);
+            __m256 cz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[8], x), _mm256_mul_ps(m[9], y)), _mm256_mul_ps(m[10], z)), m[11]);
+            __m256 cw = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[12], x), _mm256_mul_ps(m[13], y)), _mm256_mul_ps(m[14], z)), m[15]);
+            outcodeAVX2(cx, cy, cz, cw, &out.outcode[i]);
+            cx = _mm256_div_ps(cx, cw);
+            cy = _mm256_div_ps(cy, cw);
+            cz = _mm256_div_ps(cz, cw);
+
+            _mm256_store_ps(&out.x[i], _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(cx, one), half), width));
+            _mm256_store_ps(&out.y[i], _mm256_sub_ps(height, _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(cy, one), half), height)));
+            _mm256_store_ps(&out.z[i], cz);
+
+            __m256 n0 = _mm256_load_ps(&in.nx[i]), n1 = _mm256_load_ps(&in.ny[i]), n2 = _mm256_load_ps(&in.nz[i]);
+            __m256 wx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w[0], n0), _mm256_mul_ps(w[1], n1)), _mm256_mul_ps(w[2], n2));
+            __m256 wy = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w[3], n0), _mm256_mul_ps(w[4], n1)), _mm256_mul_ps(w[5], n2));
+            __m256 wz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w[6], n0), _mm256_mul_ps(w[7], n1)), _mm256_mul_ps(w[8], n2));
+            __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(wx, wx), _mm256_mul_ps(wy, wy)), _mm256_mul_ps(wz, wz)));
+            _mm256_store_ps(&out.nx[i], _mm256_div_ps(wx, length));
+            _mm256_store_ps(&out.ny[i], _mm256_div_ps(wy, length));
+            _mm256_store_ps(&out.nz[i], _mm256_div_ps(wz, length));
+        }
+    }
+
+public:
+    // Transforms every vertex of a set of streams
+    // Input Variables:
+    // - in: Object-space vertex streams
+    // - p: Combined perspective, camera and world transformation
+    // - world: World transformation, used for the normals
+    // - width, height: Screen dimensions in pixels
+    // Output Variables:
+    // - out: Screen-space positions and world-space normals, one per input vertex
+    static void transform(const VertexStreams& in, const matrix& p, const matrix& world, float width, float height, TransformedVertices& out) {
+        Coefficients c;
+        setup(p, world, width, height, c);
+        out.resize(in.size());
+
+        // Padding lanes hold zeros and produce NaNs, they are never read back
+        switch (simdLevel()) {
+        case SimdLevel::AVX2: transformAVX2(in, c, out); break;
+        case SimdLevel::SSE41: transformSSE41(in, c, out); break;
+        default: transformScalar(in, c, out); break;
+        }
+    }
+};
@@ -1,16 +1,46 @@
 #pragma once
 
 #include <concepts>
+#include <type_traits>
+#include <xmmintrin.h>
+#include "platform.h"
 
 // Zbuffer class for managing depth values during rendering.
 // This class is template-constrained to only work with floating-point types (`float` or `double`).
+// Alongside the per-pixel depths it keeps a coarse level holding the farthest depth of every
+// 8x8 tile, so the rasterizer can reject whole blocks or triangles that are already hidden.
+//
+// Clearing every pixel each frame can be skipped: resetTiles(false) only starts a new frame
+// generation, and a tile whose tag is from an older frame counts as cleared. The rasterizer calls
+// prepareTile before it touches a tile's pixels, which clears the tile on first use, so tiles the
+// frame never covers cost nothing. Code reading pixels it may not have drawn uses depth().
 
 template<std::floating_point T> // Restricts T to be a floating-point type
 class Zbuffer {
     T* buffer;                  // Pointer to the buffer storing depth values
     unsigned int width, height; // Dimensions of the Z-buffer
+    T* tileMax;                 // Conservative (farthest) depth of each tile
+    unsigned int tilesX, tilesY; // Number of tiles across and down the buffer
+    unsigned int* tileFrame;    // Frame generation in which each tile's pixels were last cleared
+    unsigned int frame = 0;     // Current frame generation
+
+    // Sets count depths starting at row to the far plane
+    void fillRow(T* row, unsigned int count) {
+        unsigned int i = 0;
+        if constexpr (std::is_same_v<T, float>) {
+            const __m128 far = _mm_set1_ps(1.0f);
+            for (; i + 8 <= count; i += 8) {
+                _mm_storeu_ps(row + i, far);
+                _mm_storeu_ps(row + i + 4, far);
+            }
+        }
+        for (; i < count; i++)
+            row[i] = 1.0f;
+    }
 
 public:
+    static const unsigned int tileSize = 8; // Width and height of a coarse tile in pixels
+
     // Constructor to initialize a Z-buffer with the given width and height.
     // Allocates memory for the buffer.
     // Input Variables:
@@ -33,6 +63,13 @@ public:
         width = w;
         height = h;
         buffer = new T[width * height]; // Allocate memory for the buffer
+
+        tilesX = (width + tileSize - 1) / tileSize;
+        tilesY = (height + tileSize - 1) / tileSize;
+        tileMax = new T[tilesX * tilesY];
+        tileFrame = new unsigned int[tilesX * tilesY](); // Generation 0 is never current, see resetTiles
+        frame = 0;
+        resetTiles(false);
     }
 
     // Accesses the depth value at the specified (x, y) coordinate.
@@ -44,16 +81,127 @@ public:
         return buffer[(y * width) + x]; // Convert 2D coordinates to 1D index
     }
 
+    // Returns the depth at (x, y), reading the far plane for tiles not yet cleared this frame.
+    // Input Variables:
+    // - x: X-coordinate of the pixel.
+    // - y: Y-coordinate of the pixel.
+    T depth(unsigned int x, unsigned int y) const {
+        if (tileFrame[(y / tileSize) * tilesX + x / tileSize] != frame) return 1.0f;
+        return buffer[(y * width) + x];
+    }
+
     // Clears the Z-buffer by setting all depth values to 1.0f,
     // which represents the farthest possible depth.
     void clear() {
-        for (unsigned int i = 0; i < width * height; i++) {
-            buffer[i] = 1.0f; // Reset each depth value
+        clearRows(0, height);
+        resetTiles(true);
+    }
+
+    // Sets the depth values of a band of rows to 1.0f. Bands can be cleared in parallel,
+    // followed by one call to resetTiles(true) once all of them are done.
+    // Input Variables:
+    // - y0, y1: First and last (exclusive) row of the band
+    void clearRows(unsigned int y0, unsigned int y1) {
+        for (unsigned int y = y0; y < y1; y++)
+            fillRow(&buffer[y * width], width);
+    }
+
+    // Starts a new frame: every tile is at the far plane again.
+    // Input Variables:
+    // - pixelsCleared: True if every pixel was just cleared, false to leave the pixels alone and have
+    //   prepareTile clear each tile the first time it is drawn to
+    void resetTiles(bool pixelsCleared) {
+        if (++frame == 0) {
+            // The generation wrapped around, start again above the initial tags
+            for (unsigned int i = 0; i < tilesX * tilesY; i++)
+                tileFrame[i] = 0;
+            frame = 1;
+        }
+        for (unsigned int i = 0; i < tilesX * tilesY; i++) {
+            tileMax[i] = 1.0f; // Every tile starts at the far plane
+            if (pixelsCleared) tileFrame[i] = frame;
+        }
+    }
+
+    // Clears the pixels of a tile if this frame has not done so yet. Must be called before any
+    // pixel of the tile is read or written through operator ().
+    // Input Variables:
+    // - tx, ty: Tile coordinates
+    void prepareTile(unsigned int tx, unsigned int ty) {
+        unsigned int& tag = tileFrame[ty * tilesX + tx];
+        if (tag == frame) return;
+        tag = frame;
+        unsigned int x0 = tx * tileSize, y0 = ty * tileSize;
+        unsigned int x1 = min(x0 + tileSize, width), y1 = min(y0 + tileSize, height);
+        for (unsigned int y = y0; y < y1; y++)
+            fillRow(&buffer[y * width + x0], x1 - x0);
+    }
+
+    // Returns the farthest depth stored in a coarse tile.
+    // Any pixel of the tile that is at or behind this depth is guaranteed to be hidden.
+    // Input Variables:
+    // - tx, ty: Tile coordinates
+    T tileDepth(unsigned int tx, unsigned int ty) const {
+        return tileMax[ty * tilesX + tx];
+    }
+
+    // Returns the farthest depth over all tiles touching a pixel rectangle
+    // Input Variables:
+    // - x0, y0: Top-left pixel of the rectangle (inclusive)
+    // - x1, y1: Bottom-right pixel of the rectangle (exclusive)
+    T maxDepth(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1) const {
+        T farthest = 0;
+        for (unsigned int ty = y0 / tileSize; ty <= (y1 - 1) / tileSize; ty++)
+            for (unsigned int tx = x0 / tileSize; tx <= (x1 - 1) / tileSize; tx++)
+                farthest = max(farthest, tileMax[ty * tilesX + tx]);
+        return farthest;
+    }
+
+    // Recomputes the farthest depth of a tile after some of its pixels have been written.
+    // Input Variables:
+    // - tx, ty: Tile coordinates
+    void updateTile(unsigned int tx, unsigned int ty) {
+        unsigned int x0 = tx * tileSize, y0 = ty * tileSize;
+        unsigned int x1 = min(x0 + tileSize, width), y1 = min(y0 + tileSize, height);
+
+        // Whole float tiles are two SSE registers per row
+        if constexpr (std::is_same_v<T, float>) {
+            if (x1 - x0 == tileSize) {
+                __m128 farthest = _mm_setzero_ps();
+                for (unsigned int y = y0; y < y1; y++) {
+                    const float* row = &buffer[y * width + x0];
+                    farthest = _mm_max_ps(farthest, _mm_max_ps(_mm_loadu_ps(row), _mm_loadu_ps(row + 4)));
+                }
+                farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+                farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+                tileMax[ty * tilesX + tx] = _mm_cvtss_f32(farthest);
+                return;
+            }
         }
+
+        T farthest = 0;
+        for (unsigned int y = y0; y < y1; y++) {
+            const T* row = &buffer[y * width];
+            for (unsigned int x = x0; x < x1; x++)
+                farthest = row[x] > farthest ? row[x] : farthest;
+        }
+        tileMax[ty * tilesX + tx] = farthest;
+    }
+
+    // Lowers the farthest depth of a tile that has just been completely covered by a
+    // surface no farther than the given depth. Cheaper than updateTile as no pixels are read.
+    // Input Variables:
+    // - tx, ty: Tile coordinates
+    // - depth: Farthest depth of the covering surface within the tile
+    void coverTile(unsigned int tx, unsigned int ty, T depth) {
+        T& farthest = tileMax[ty * tilesX + tx];
+        if (depth < farthest) farthest = depth;
     }
 
     // Destructor to clean up memory allocated for the Z-buffer.
     ~Zbuffer() {
         delete[] buffer; // Free the allocated memory
+        delete[] tileMax;
+        delete[] tileFrame;
     }
 };